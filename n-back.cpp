@@ -10,8 +10,17 @@
 #include <limits>
 #include <fstream>
 #include <map>
+#include <unordered_map>
 #include <sstream>
 #include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <csignal>
+#include <deque>
+#include <random>
+#include <mutex>
+#include <condition_variable>
+#include <cmath>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -24,543 +33,4790 @@
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 using namespace std;
 
-// 清除控制台屏幕的函数
-void clearScreen() {
-#ifdef _WIN32
-    system("cls");
+// 低开销延迟直方图(HDR 风格的对数-线性分桶)：每个 2 的幂区间再均分 32 个子桶，
+// 相对误差约 3%，记录一次只需一次位运算和一次自增。数值单位为微秒
+class LatencyHistogram {
+private:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS) * SUB_BUCKETS + SUB_BUCKETS;
+    
+    vector<uint64_t> counts;
+    uint64_t totalCount;
+    uint64_t minValue;
+    uint64_t maxValue;
+    double sum;
+    
+    // v 不能为 0
+    static int highestBit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(v);
 #else
-    system("clear");
+        int bit = 0;
+        while (v >>= 1) bit++;
+        return bit;
 #endif
-}
-
-// 非阻塞键盘输入检测
-bool checkKeyPress() {
-#ifdef _WIN32
-    return _kbhit() != 0;
-#else
-    struct termios oldt, newt;
-    int ch;
-    int oldf;
+    }
     
-    tcgetattr(STDIN_FILENO, &oldt);
-    newt = oldt;
-    newt.c_lflag &= ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    oldf = fcntl(STDIN_FILENO, F_GETFL, 0);
-    fcntl(STDIN_FILENO, F_SETFL, oldf | O_NONBLOCK);
+    static int bucketIndex(uint64_t value) {
+        int shift = max(0, highestBit(value | 1) - SUB_BUCKET_BITS);
+        return (shift << SUB_BUCKET_BITS) + (int)(value >> shift);
+    }
     
-    ch = getchar();
+    // 桶内最大值，用于报告百分位(偏保守)
+    static uint64_t bucketUpperValue(int index) {
+        if (index < 2 * SUB_BUCKETS) return (uint64_t)index;
+        int shift = index / SUB_BUCKETS - 1;
+        uint64_t mantissa = (uint64_t)(index - shift * SUB_BUCKETS);
+        return ((mantissa + 1) << shift) - 1;
+    }
     
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    fcntl(STDIN_FILENO, F_SETFL, oldf);
+public:
+    LatencyHistogram() : counts(BUCKET_COUNT, 0), totalCount(0), minValue(0), maxValue(0), sum(0) {}
     
-    if(ch != EOF) {
-        ungetc(ch, stdin);
-        return true;
+    void record(uint64_t value) {
+        counts[bucketIndex(value)]++;
+        if (totalCount == 0 || value < minValue) minValue = value;
+        if (value > maxValue) maxValue = value;
+        totalCount++;
+        sum += (double)value;
     }
     
-    return false;
-#endif
-}
-
-// 获取非阻塞输入
-char getKeyInput() {
-    if(checkKeyPress()) {
-#ifdef _WIN32
-        return _getch();
-#else
-        return getchar();
-#endif
+    void reset() {
+        fill(counts.begin(), counts.end(), 0);
+        totalCount = 0;
+        minValue = maxValue = 0;
+        sum = 0;
     }
-    return 0;
-}
-
-// 刺激结构体
-struct Stimulus {
-    int visualPosition;  // 0-8 表示3x3网格中的位置
-    char auditoryLetter; // 播放的字母
-};
-
-// 成就枚举
-enum Achievement {
-    ACH_NOVICE,        // 初学者：完成一次测试
-    ACH_MEMORY_MASTER, // 记忆大师：准确率超过90%
-    ACH_FAST_THINKER,  // 快速思考者：平均响应时间<1000ms
-    ACH_PERFECT_SCORE, // 完美分数：100%准确率
-    ACH_CHALLENGER,    // 挑战者：完成N=5的测试
-    ACH_MULTIPLAYER,   // 多人游戏：完成多人游戏
-    ACH_CONSISTENT,    // 稳定发挥：连续3次准确率>80%
-    ACH_TOTAL_TESTS,   // 测试达人：完成10次测试
-    ACH_DUAL_EXPERT,   // 双项专家：视觉和听觉都>90%
-    ACH_NINJA,         // 记忆忍者：N=3且准确率>85%
-    ACH_COUNT          // 成就总数
+    
+    void merge(const LatencyHistogram& other) {
+        if (other.totalCount == 0) return;
+        for (int i = 0; i < BUCKET_COUNT; i++) counts[i] += other.counts[i];
+        if (totalCount == 0 || other.minValue < minValue) minValue = other.minValue;
+        maxValue = max(maxValue, other.maxValue);
+        totalCount += other.totalCount;
+        sum += other.sum;
+    }
+    
+    // 百分位数，percentile 取 0-100
+    uint64_t valueAtPercentile(double percentile) const {
+        if (totalCount == 0) return 0;
+        uint64_t target = (uint64_t)(percentile / 100.0 * totalCount + 0.5);
+        if (target < 1) target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += counts[i];
+            if (seen >= target) return min(bucketUpperValue(i), maxValue);
+        }
+        return maxValue;
+    }
+    
+    uint64_t count() const { return totalCount; }
+    uint64_t minimum() const { return minValue; }
+    uint64_t maximum() const { return maxValue; }
+    double mean() const { return totalCount ? sum / totalCount : 0; }
 };
 
-// 成就名称和描述
-const string ACHIEVEMENT_NAMES[ACH_COUNT] = {
-    "初学者",
-    "记忆大师",
-    "快速思考者",
-    "完美分数",
-    "挑战者",
-    "多人游戏",
-    "稳定发挥",
-    "测试达人",
-    "双项专家",
-    "记忆忍者"
+// 热点路径计时探针
+enum TimingProbe {
+    PROBE_ONSET_LATENESS, // 刺激实际出现时间晚于计划的时间
+    PROBE_INPUT_WAKE,     // 输入等待超时后实际唤醒晚于截止时间的时间
+    PROBE_RENDER,         // 刺激画面(displayGrid)生成并输出一帧的时间
+    PROBE_SAVE_STATS,     // savePlayerStats 耗时
+    PROBE_NET_SEND,       // NetworkManager 发送耗时
+    PROBE_NET_RECV,       // NetworkManager 接收耗时
+    PROBE_COUNT
 };
 
-const string ACHIEVEMENT_DESCS[ACH_COUNT] = {
-    "完成第一次N-Back测试",
-    "总体准确率超过90%",
-    "平均响应时间小于1000毫秒",
-    "获得100%准确率",
-    "完成N=5的高难度测试",
-    "参与多人挑战赛",
-    "连续3次测试准确率超过80%",
-    "完成总计10次测试",
-    "视觉和听觉准确率都超过90%",
-    "在N=3难度下获得85%以上准确率"
+const char* const TIMING_PROBE_NAMES[PROBE_COUNT] = {
+    "onset_lateness",
+    "input_wake",
+    "render_frame",
+    "save_player_stats",
+    "net_send",
+    "net_recv"
 };
 
-// 玩家统计
-struct PlayerStats {
-    string name;
-    int totalTests;
-    int totalTrials;
-    int maxNLevel;
-    double bestAccuracy;
-    double bestResponseTime;
-    int achievements[ACH_COUNT];
-    vector<double> recentAccuracies;
+// 本次会话的计时数据：每个探针一个直方图，会话结束时可输出或追加到文件
+// 负载测试时主机和模拟客户端在不同线程里同时记录，记录、清零和读取都加锁
+class TimingProbes {
+private:
+    LatencyHistogram histograms[PROBE_COUNT];
+    mutable mutex probeMutex;
     
-    PlayerStats() : name(""), totalTests(0), totalTrials(0), maxNLevel(0),
-                   bestAccuracy(0), bestResponseTime(10000) {
-        memset(achievements, 0, sizeof(achievements));
+    TimingProbes() {}
+    
+public:
+    static TimingProbes& instance() {
+        static TimingProbes probes;
+        return probes;
     }
-};
-
-// 游戏统计
-struct GameStats {
-    string playerName;
-    int nValue;
-    int totalTrials;
-    int visualHits;
-    int visualFalseAlarms;
-    int visualMisses;
-    int visualCorrectRejections;
-    int auditoryHits;
-    int auditoryFalseAlarms;
-    int auditoryMisses;
-    int auditoryCorrectRejections;
-    double visualAccuracy;
-    double auditoryAccuracy;
-    double overallAccuracy;
-    double responseTimeAvg;
     
-    GameStats() : playerName(""), nValue(0), totalTrials(0),
-                 visualHits(0), visualFalseAlarms(0), visualMisses(0), visualCorrectRejections(0),
-                 auditoryHits(0), auditoryFalseAlarms(0), auditoryMisses(0), auditoryCorrectRejections(0),
-                 visualAccuracy(0), auditoryAccuracy(0), overallAccuracy(0), responseTimeAvg(0) {}
+    void record(TimingProbe probe, chrono::steady_clock::duration elapsed) {
+        long long us = chrono::duration_cast<chrono::microseconds>(elapsed).count();
+        lock_guard<mutex> lock(probeMutex);
+        histograms[probe].record(us > 0 ? (uint64_t)us : 0);
+    }
     
-    void calculateAccuracies() {
-        int visualTotal = visualHits + visualMisses + visualFalseAlarms + visualCorrectRejections;
-        int auditoryTotal = auditoryHits + auditoryMisses + auditoryFalseAlarms + auditoryCorrectRejections;
-        
-        if (visualTotal > 0) {
-            visualAccuracy = (visualHits + visualCorrectRejections) * 100.0 / visualTotal;
-        }
-        
-        if (auditoryTotal > 0) {
-            auditoryAccuracy = (auditoryHits + auditoryCorrectRejections) * 100.0 / auditoryTotal;
+    // 返回一份快照，之后的记录不影响它
+    LatencyHistogram histogram(TimingProbe probe) const {
+        lock_guard<mutex> lock(probeMutex);
+        return histograms[probe];
+    }
+    
+    void reset() {
+        lock_guard<mutex> lock(probeMutex);
+        for (LatencyHistogram& h : histograms) h.reset();
+    }
+    
+    // 人可读的汇总表(微秒)
+    void dump(ostream& out) const {
+        lock_guard<mutex> lock(probeMutex);
+        out << left << setw(20) << "probe" << right << setw(8) << "count" << setw(10) << "p50"
+            << setw(10) << "p90" << setw(10) << "p99" << setw(10) << "max" << "  (us)\n";
+        for (int i = 0; i < PROBE_COUNT; i++) {
+            const LatencyHistogram& h = histograms[i];
+            out << left << setw(20) << TIMING_PROBE_NAMES[i] << right << setw(8) << h.count()
+                << setw(10) << h.valueAtPercentile(50) << setw(10) << h.valueAtPercentile(90)
+                << setw(10) << h.valueAtPercentile(99) << setw(10) << h.maximum() << "\n";
         }
+        out << left;
+    }
+    
+    // 以一行 JSON 的形式追加到文件，便于机器处理
+    bool appendJsonLine(const string& path, const string& label) const {
+        ofstream outFile(path, ios::app);
+        if (!outFile) return false;
         
-        if (visualTotal + auditoryTotal > 0) {
-            overallAccuracy = (visualHits + visualCorrectRejections + 
-                              auditoryHits + auditoryCorrectRejections) * 100.0 / 
-                              (visualTotal + auditoryTotal);
+        lock_guard<mutex> lock(probeMutex);
+        outFile << "{\"time\":" << (long long)time(nullptr) << ",\"label\":\"" << label << "\",\"unit\":\"us\"";
+        for (int i = 0; i < PROBE_COUNT; i++) {
+            const LatencyHistogram& h = histograms[i];
+            outFile << ",\"" << TIMING_PROBE_NAMES[i] << "\":{\"count\":" << h.count()
+                    << ",\"min\":" << h.minimum() << ",\"mean\":" << (uint64_t)h.mean()
+                    << ",\"p50\":" << h.valueAtPercentile(50) << ",\"p90\":" << h.valueAtPercentile(90)
+                    << ",\"p99\":" << h.valueAtPercentile(99) << ",\"p999\":" << h.valueAtPercentile(99.9)
+                    << ",\"max\":" << h.maximum() << "}";
         }
+        outFile << "}\n";
+        return true;
     }
 };
 
-// 玩家信息
-struct Player {
-    string name;
-    GameStats currentStats;
-    PlayerStats careerStats;
-    bool isActive;
+// 作用域计时：离开作用域时把耗时记到指定探针
+class ScopedTimer {
+private:
+    TimingProbe probe;
+    chrono::steady_clock::time_point start;
+    
+public:
+    explicit ScopedTimer(TimingProbe p) : probe(p), start(chrono::steady_clock::now()) {}
+    ~ScopedTimer() { TimingProbes::instance().record(probe, chrono::steady_clock::now() - start); }
 };
 
-// 成就系统类
-class AchievementSystem {
+// 屏幕渲染器：在进程内维护帧缓冲，记录上一帧内容，
+// 只用 ANSI 转义序列重写发生变化的单元格，每帧一次 write() 输出
+class ScreenRenderer {
 private:
-    map<string, PlayerStats> allPlayers;
+    vector<string> previousRows;
+    ostringstream currentFrame;
+    bool fullRedraw;
+#ifdef _WIN32
+    HANDLE outputHandle;
+#else
+    int outputFd;
+#endif
     
-public:
-    void loadPlayerStats() {
-        ifstream inFile("player_stats.dat", ios::binary);
-        if (!inFile) return;
-        
-        while (!inFile.eof()) {
-            PlayerStats stats;
-            size_t nameLen;
-            
-            inFile.read((char*)&nameLen, sizeof(nameLen));
-            if (inFile.eof()) break;
-            
-            char* nameBuf = new char[nameLen + 1];
-            inFile.read(nameBuf, nameLen);
-            nameBuf[nameLen] = '\0';
-            stats.name = nameBuf;
-            delete[] nameBuf;
-            
-            inFile.read((char*)&stats.totalTests, sizeof(stats.totalTests));
-            inFile.read((char*)&stats.totalTrials, sizeof(stats.totalTrials));
-            inFile.read((char*)&stats.maxNLevel, sizeof(stats.maxNLevel));
-            inFile.read((char*)&stats.bestAccuracy, sizeof(stats.bestAccuracy));
-            inFile.read((char*)&stats.bestResponseTime, sizeof(stats.bestResponseTime));
-            inFile.read((char*)stats.achievements, sizeof(stats.achievements));
-            
-            allPlayers[stats.name] = stats;
-        }
-        
-        inFile.close();
+    ScreenRenderer() : fullRedraw(true) {
+#ifdef _WIN32
+        outputHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+#else
+        outputFd = STDOUT_FILENO;
+#endif
     }
     
-    void savePlayerStats() {
-        ofstream outFile("player_stats.dat", ios::binary);
-        if (!outFile) return;
-        
-        for (const auto& pair : allPlayers) {
-            const PlayerStats& stats = pair.second;
-            size_t nameLen = stats.name.length();
-            
-            outFile.write((const char*)&nameLen, sizeof(nameLen));
-            outFile.write(stats.name.c_str(), nameLen);
-            outFile.write((const char*)&stats.totalTests, sizeof(stats.totalTests));
-            outFile.write((const char*)&stats.totalTrials, sizeof(stats.totalTrials));
-            outFile.write((const char*)&stats.maxNLevel, sizeof(stats.maxNLevel));
-            outFile.write((const char*)&stats.bestAccuracy, sizeof(stats.bestAccuracy));
-            outFile.write((const char*)&stats.bestResponseTime, sizeof(stats.bestResponseTime));
-            outFile.write((const char*)stats.achievements, sizeof(stats.achievements));
+    // 单元格显示宽度：中日韩字符和全角符号占两列
+    static int codepointWidth(unsigned int cp) {
+        if ((cp >= 0x1100 && cp <= 0x115F) || (cp >= 0x2E80 && cp <= 0xA4CF) ||
+            (cp >= 0xAC00 && cp <= 0xD7A3) || (cp >= 0xF900 && cp <= 0xFAFF) ||
+            (cp >= 0xFE30 && cp <= 0xFE4F) || (cp >= 0xFF00 && cp <= 0xFF60) ||
+            (cp >= 0xFFE0 && cp <= 0xFFE6) || cp >= 0x20000) {
+            return 2;
         }
-        
-        outFile.close();
+        return 1;
     }
     
-    PlayerStats* getPlayerStats(const string& name) {
-        if (allPlayers.find(name) == allPlayers.end()) {
-            PlayerStats newStats;
-            newStats.name = name;
-            allPlayers[name] = newStats;
+    struct Cell {
+        size_t offset; // 在行字符串中的字节偏移
+        int column;    // 起始列
+    };
+    
+    // 把一行 UTF-8 文本拆成单元格，返回整行显示宽度
+    static int splitCells(const string& row, vector<Cell>& cells) {
+        cells.clear();
+        int column = 0;
+        size_t i = 0;
+        while (i < row.size()) {
+            unsigned char c = row[i];
+            size_t len = 1;
+            unsigned int cp = c;
+            if (c >= 0xF0) { len = 4; cp = c & 0x07; }
+            else if (c >= 0xE0) { len = 3; cp = c & 0x0F; }
+            else if (c >= 0xC0) { len = 2; cp = c & 0x1F; }
+            for (size_t k = 1; k < len && i + k < row.size(); k++) {
+                cp = (cp << 6) | (row[i + k] & 0x3F);
+            }
+            cells.push_back({i, column});
+            column += codepointWidth(cp);
+            i += len;
         }
-        return &allPlayers[name];
+        return column;
     }
     
-    vector<string> checkAchievements(PlayerStats& stats, const GameStats& gameStats) {
-        vector<string> newAchievements;
-        
-        // 成就1: 初学者
-        if (stats.totalTests == 1 && stats.achievements[ACH_NOVICE] == 0) {
-            stats.achievements[ACH_NOVICE] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_NOVICE]);
-        }
-        
-        // 成就2: 记忆大师
-        if (gameStats.overallAccuracy >= 90.0 && stats.achievements[ACH_MEMORY_MASTER] == 0) {
-            stats.achievements[ACH_MEMORY_MASTER] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_MEMORY_MASTER]);
-        }
+    static void moveCursor(string& out, size_t row, int column) {
+        out += "\x1b[" + to_string(row + 1) + ";" + to_string(column + 1) + "H";
+    }
+    
+    // 生成把 oldRow 改写成 newRow 所需的最少输出
+    static void diffRow(string& out, size_t rowIndex, const string& oldRow, const string& newRow,
+                        vector<Cell>& oldCells, vector<Cell>& newCells) {
+        int oldWidth = splitCells(oldRow, oldCells);
+        int newWidth = splitCells(newRow, newCells);
         
-        // 成就3: 快速思考者
-        if (gameStats.responseTimeAvg <= 1000.0 && stats.achievements[ACH_FAST_THINKER] == 0) {
-            stats.achievements[ACH_FAST_THINKER] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_FAST_THINKER]);
+        // 从行首找第一个不同的单元格
+        size_t first = 0;
+        while (first < oldCells.size() && first < newCells.size()) {
+            size_t oldEnd = first + 1 < oldCells.size() ? oldCells[first + 1].offset : oldRow.size();
+            size_t newEnd = first + 1 < newCells.size() ? newCells[first + 1].offset : newRow.size();
+            if (oldEnd - oldCells[first].offset != newEnd - newCells[first].offset ||
+                oldRow.compare(oldCells[first].offset, oldEnd - oldCells[first].offset,
+                               newRow, newCells[first].offset, newEnd - newCells[first].offset) != 0) {
+                break;
+            }
+            first++;
         }
         
-        // 成就4: 完美分数
-        if (gameStats.overallAccuracy >= 99.9 && stats.achievements[ACH_PERFECT_SCORE] == 0) {
-            stats.achievements[ACH_PERFECT_SCORE] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_PERFECT_SCORE]);
-        }
+        size_t newBegin = first < newCells.size() ? newCells[first].offset : newRow.size();
+        size_t newEnd = newRow.size();
+        int startColumn = first < newCells.size() ? newCells[first].column : newWidth;
         
-        // 成就5: 挑战者
-        if (gameStats.nValue >= 5 && stats.achievements[ACH_CHALLENGER] == 0) {
-            stats.achievements[ACH_CHALLENGER] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_CHALLENGER]);
+        // 宽度不变时再从行尾找最后一个不同的单元格，只重写中间部分
+        if (oldWidth == newWidth) {
+            size_t oldTail = oldRow.size();
+            size_t newTail = newRow.size();
+            while (newTail > newBegin && oldTail > 0 && oldRow[oldTail - 1] == newRow[newTail - 1]) {
+                oldTail--;
+                newTail--;
+            }
+            // 退回到单元格边界
+            while (newTail < newRow.size() && (newRow[newTail] & 0xC0) == 0x80) {
+                newTail++;
+            }
+            newEnd = newTail;
         }
         
-        // 成就8: 测试达人
-        if (stats.totalTests >= 10 && stats.achievements[ACH_TOTAL_TESTS] == 0) {
-            stats.achievements[ACH_TOTAL_TESTS] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_TOTAL_TESTS]);
+        if (newBegin < newEnd) {
+            moveCursor(out, rowIndex, startColumn);
+            out.append(newRow, newBegin, newEnd - newBegin);
         }
-        
-        // 成就9: 双项专家
-        if (gameStats.visualAccuracy >= 90.0 && gameStats.auditoryAccuracy >= 90.0 && 
-            stats.achievements[ACH_DUAL_EXPERT] == 0) {
-            stats.achievements[ACH_DUAL_EXPERT] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_DUAL_EXPERT]);
+        if (newWidth < oldWidth) {
+            if (newBegin >= newEnd) moveCursor(out, rowIndex, newWidth);
+            out += "\x1b[K";
         }
-        
-        // 成就10: 记忆忍者
-        if (gameStats.nValue >= 3 && gameStats.overallAccuracy >= 85.0 && 
-            stats.achievements[ACH_NINJA] == 0) {
-            stats.achievements[ACH_NINJA] = 1;
-            newAchievements.push_back(ACHIEVEMENT_NAMES[ACH_NINJA]);
+    }
+    
+    // 写出整帧，全部写完返回 true；输出暂时写不进(EAGAIN)时等到可写再继续
+    bool writeOut(const string& out) {
+        cout << flush;
+#ifdef _WIN32
+        DWORD written = 0;
+        return WriteFile(outputHandle, out.data(), (DWORD)out.size(), &written, nullptr) &&
+               written == (DWORD)out.size();
+#else
+        size_t done = 0;
+        while (done < out.size()) {
+            ssize_t ret = write(outputFd, out.data() + done, out.size() - done);
+            if (ret > 0) {
+                done += ret;
+            } else if (ret < 0 && errno == EINTR) {
+                continue;
+            } else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                pollfd pfd;
+                pfd.fd = outputFd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return false;
+            } else {
+                return false;
+            }
         }
-        
-        return newAchievements;
+        return true;
+#endif
     }
     
-    void updatePlayerStats(PlayerStats& stats, const GameStats& gameStats) {
-        stats.totalTests++;
-        stats.totalTrials += gameStats.totalTrials;
-        
-        if (gameStats.nValue > stats.maxNLevel) {
-            stats.maxNLevel = gameStats.nValue;
+public:
+    static ScreenRenderer& instance() {
+        static ScreenRenderer renderer;
+        return renderer;
+    }
+    
+    // 开始新的一帧，返回写入帧内容的流
+    ostream& beginFrame() {
+        currentFrame.str("");
+        currentFrame.clear();
+        return currentFrame;
+    }
+    
+    ostream& frame() { return currentFrame; }
+    
+    // 屏幕被其他输出改写后调用，下一帧整屏重绘
+    void invalidate() {
+        fullRedraw = true;
+        previousRows.clear();
+    }
+    
+    // 输出当前帧：与上一帧比较，只发送变化的部分
+    void present() {
+        string text = currentFrame.str();
+        vector<string> rows;
+        size_t start = 0;
+        while (true) {
+            size_t end = text.find('\n', start);
+            if (end == string::npos) {
+                rows.push_back(text.substr(start));
+                break;
+            }
+            rows.push_back(text.substr(start, end - start));
+            start = end + 1;
         }
         
-        if (gameStats.overallAccuracy > stats.bestAccuracy) {
-            stats.bestAccuracy = gameStats.overallAccuracy;
+        string out;
+        vector<Cell> oldCells, newCells;
+        if (fullRedraw) {
+            out = "\x1b[H\x1b[2J";
+            for (size_t r = 0; r < rows.size(); r++) {
+                if (r > 0) out += "\r\n";
+                out += rows[r];
+            }
+            fullRedraw = false;
+        } else {
+            size_t rowCount = max(rows.size(), previousRows.size());
+            for (size_t r = 0; r < rowCount; r++) {
+                if (r >= rows.size()) {
+                    moveCursor(out, r, 0);
+                    out += "\x1b[2K";
+                } else if (r >= previousRows.size()) {
+                    diffRow(out, r, "", rows[r], oldCells, newCells);
+                } else if (rows[r] != previousRows[r]) {
+                    diffRow(out, r, previousRows[r], rows[r], oldCells, newCells);
+                }
+            }
+            // 光标停在帧内容末尾，与整屏输出时的位置一致
+            moveCursor(out, rows.size() - 1, splitCells(rows.back(), newCells));
         }
         
-        if (gameStats.responseTimeAvg < stats.bestResponseTime) {
-            stats.bestResponseTime = gameStats.responseTimeAvg;
+        // 没写完时终端上的内容已不可知，下一帧整屏重绘
+        if (writeOut(out)) {
+            previousRows.swap(rows);
+        } else {
+            invalidate();
         }
-        
-        stats.recentAccuracies.push_back(gameStats.overallAccuracy);
-        if (stats.recentAccuracies.size() > 3) {
-            stats.recentAccuracies.erase(stats.recentAccuracies.begin());
+    }
+};
+
+// 清除控制台屏幕的函数
+void clearScreen() {
+    cout << "\x1b[H\x1b[2J" << flush;
+    ScreenRenderer::instance().invalidate();
+}
+
+#ifndef _WIN32
+// 进入原始模式前的终端设置，信号处理函数中也要用到，所以放在全局
+static struct termios g_savedTermios;
+static volatile sig_atomic_t g_terminalRaw = 0;
+
+// 恢复终端设置(只调用异步信号安全的函数)
+static void restoreTerminalState() {
+    if (g_terminalRaw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &g_savedTermios);
+        g_terminalRaw = 0;
+    }
+}
+
+static void terminalSignalHandler(int sig) {
+    restoreTerminalState();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+#endif
+
+// 一次按键及其到达时间(单调时钟)
+struct KeyEvent {
+    char key;
+    chrono::steady_clock::time_point time;
+};
+
+// 终端会话：一次会话只切换一次原始(非规范、无回显、非阻塞)模式，
+// 按键统一读入用户态缓冲区，退出或收到信号时自动恢复终端
+class TerminalSession {
+private:
+    int rawDepth;
+    deque<KeyEvent> keyBuffer;
+    bool handlersInstalled;
+    
+    TerminalSession() : rawDepth(0), handlersInstalled(false) {}
+    
+    void installHandlers() {
+        if (handlersInstalled) return;
+        handlersInstalled = true;
+#ifndef _WIN32
+        atexit(restoreTerminalState);
+        signal(SIGINT, terminalSignalHandler);
+        signal(SIGTERM, terminalSignalHandler);
+        signal(SIGHUP, terminalSignalHandler);
+        signal(SIGQUIT, terminalSignalHandler);
+#endif
+    }
+    
+    // 把已到达的按键全部读入缓冲区，返回读到的字节数
+    int drainInput() {
+        int count = 0;
+        auto now = chrono::steady_clock::now();
+#ifdef _WIN32
+        while (_kbhit()) {
+            keyBuffer.push_back({(char)_getch(), now});
+            count++;
         }
-        
-        // 成就6: 稳定发挥
-        if (stats.recentAccuracies.size() == 3) {
-            bool allOver80 = true;
-            for (double acc : stats.recentAccuracies) {
-                if (acc < 80.0) {
-                    allOver80 = false;
-                    break;
+#else
+        char buf[64];
+        while (true) {
+            // 标准输入不是终端(管道、文件)时没有 VMIN/VTIME，空闲时 read 会阻塞，先确认有数据
+            pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+            if (poll(&pfd, 1, 0) <= 0) break;
+            ssize_t bytesRead = read(STDIN_FILENO, buf, sizeof(buf));
+            if (bytesRead > 0) {
+                for (ssize_t i = 0; i < bytesRead; i++) {
+                    keyBuffer.push_back({buf[i], now});
                 }
-            }
-            if (allOver80 && stats.achievements[ACH_CONSISTENT] == 0) {
-                stats.achievements[ACH_CONSISTENT] = 1;
+                count += bytesRead;
+                if (bytesRead < (ssize_t)sizeof(buf)) break;
+            } else if (bytesRead < 0 && errno == EINTR) {
+                continue;
+            } else {
+                break;
             }
         }
-        
-        savePlayerStats();
+#endif
+        return count;
     }
     
-    void displayPlayerAchievements(const string& playerName) {
-        PlayerStats* stats = getPlayerStats(playerName);
-        
-        clearScreen();
-        cout << "========================================\n";
-        cout << "      " << playerName << " 的成就系统\n";
-        cout << "========================================\n";
-        
-        cout << "\n统计信息:\n";
-        cout << "总测试次数: " << stats->totalTests << "\n";
-        cout << "总试次数量: " << stats->totalTrials << "\n";
-        cout << "最高N值: " << stats->maxNLevel << "\n";
-        cout << "最佳准确率: " << fixed << setprecision(1) << stats->bestAccuracy << "%\n";
-        cout << "最佳响应时间: " << fixed << setprecision(0) << stats->bestResponseTime << "ms\n";
-        
-        cout << "\n已获得成就 (" << getAchievementCount(*stats) << "/" << ACH_COUNT-1 << "):\n";
-        cout << "----------------------------------------\n";
+public:
+    static TerminalSession& instance() {
+        static TerminalSession session;
+        return session;
+    }
+    
+    // 进入原始模式(可嵌套，只有最外层真正切换终端)
+    void enterRaw() {
+        if (rawDepth++ > 0) return;
+        installHandlers();
+#ifndef _WIN32
+        if (!isatty(STDIN_FILENO)) return;
+        if (tcgetattr(STDIN_FILENO, &g_savedTermios) != 0) return;
         
-        int count = 0;
-        for (int i = 0; i < ACH_COUNT-1; i++) {
-            if (stats->achievements[i]) {
-                cout << "[V] " << ACHIEVEMENT_NAMES[i] << "\n";
-                cout << "    " << ACHIEVEMENT_DESCS[i] << "\n\n";
-                count++;
+        // VMIN=0/VTIME=0：没有输入时 read 立即返回 0，等待交给 poll。
+        // 不给描述符加 O_NONBLOCK：终端的打开文件描述与 stdout/stderr 共享，会让输出也变成非阻塞
+        struct termios rawTermios = g_savedTermios;
+        rawTermios.c_lflag &= ~(ICANON | ECHO);
+        rawTermios.c_cc[VMIN] = 0;
+        rawTermios.c_cc[VTIME] = 0;
+        g_terminalRaw = 1;
+        tcsetattr(STDIN_FILENO, TCSANOW, &rawTermios);
+#endif
+    }
+    
+    void leaveRaw() {
+        if (rawDepth == 0 || --rawDepth > 0) return;
+        keyBuffer.clear();
+#ifndef _WIN32
+        restoreTerminalState();
+#endif
+    }
+    
+    bool isRaw() const { return rawDepth > 0; }
+    
+    // 等待按键，直到有按键或超时(毫秒)，缓冲区非空时返回 true
+    // wakeFd 可选：该描述符可读时也提前返回(POSIX)，用于同时等待网络
+    bool waitForKey(int timeoutMs, int wakeFd = -1) {
+        if (!keyBuffer.empty()) return true;
+        if (timeoutMs < 0) timeoutMs = 0;
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+#ifdef _WIN32
+        HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+        while (!_kbhit()) {
+            long remaining = chrono::duration_cast<chrono::milliseconds>(
+                deadline - chrono::steady_clock::now()).count();
+            if (remaining <= 0) break;
+            // 控制台输入事件(含鼠标、焦点事件)也会唤醒，唤醒后再用 _kbhit 确认
+            if (WaitForSingleObject(hStdin, (DWORD)remaining) != WAIT_OBJECT_0) {
+                break;
+            }
+            if (!_kbhit()) {
+                FlushConsoleInputBuffer(hStdin);
             }
         }
+        drainInput();
+#else
+        pollfd pfd[2];
+        pfd[0].fd = STDIN_FILENO;
+        pfd[0].events = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd = wakeFd;
+        pfd[1].events = POLLIN;
+        pfd[1].revents = 0;
         
-        cout << "\n未获得成就:\n";
-        cout << "----------------------------------------\n";
-        for (int i = 0; i < ACH_COUNT-1; i++) {
-            if (!stats->achievements[i]) {
-                cout << "[ ] " << ACHIEVEMENT_NAMES[i] << "\n";
-                cout << "    " << ACHIEVEMENT_DESCS[i] << "\n\n";
+        while (true) {
+            int ret = poll(pfd, wakeFd >= 0 ? 2 : 1, timeoutMs);
+            if (ret > 0) {
+                if (drainInput() > 0) break;
+                // 输入已关闭(EOF)，不再等待
+                if (pfd[0].revents & (POLLHUP | POLLERR | POLLNVAL)) break;
+                // 网络有事件，交给调用者处理
+                if (pfd[1].revents) return false;
+            } else if (ret == 0 || errno != EINTR) {
+                break;
             }
+            // 被信号打断时按剩余时间继续等待
+            timeoutMs = (int)max<long long>(0, chrono::duration_cast<chrono::milliseconds>(
+                deadline - chrono::steady_clock::now()).count());
+            if (timeoutMs == 0) break;
         }
-        
-        cout << "========================================\n";
-        cout << "按任意键返回...";
-        cin.ignore();
-        cin.get();
+#endif
+        if (keyBuffer.empty()) {
+            // 超时唤醒：记录实际唤醒比截止时间晚了多少
+            TimingProbes::instance().record(PROBE_INPUT_WAKE, chrono::steady_clock::now() - deadline);
+            return false;
+        }
+        return true;
     }
     
-    int getAchievementCount(const PlayerStats& stats) {
-        int count = 0;
-        for (int i = 0; i < ACH_COUNT-1; i++) {
-            if (stats.achievements[i]) count++;
+    bool hasKey() {
+        if (keyBuffer.empty()) drainInput();
+        return !keyBuffer.empty();
+    }
+    
+    // 取出一个按键及其到达时间，没有按键时返回 false
+    bool getKeyEvent(KeyEvent& event) {
+        if (!hasKey()) return false;
+        event = keyBuffer.front();
+        keyBuffer.pop_front();
+        return true;
+    }
+    
+    // 取出一个按键，没有按键时返回 0
+    char getKey() {
+        KeyEvent event;
+        return getKeyEvent(event) ? event.key : 0;
+    }
+    
+    // 丢弃所有尚未处理的按键
+    void discardInput() {
+        drainInput();
+        keyBuffer.clear();
+#ifndef _WIN32
+        tcflush(STDIN_FILENO, TCIFLUSH);
+#endif
+    }
+    
+    // "按任意键继续"：阻塞直到有一个按键，返回该按键
+    char waitAnyKey() {
+        enterRaw();
+        while (!waitForKey(1000)) {
+#ifndef _WIN32
+            // 标准输入不是终端且已读完时直接返回，避免死等
+            if (!isatty(STDIN_FILENO)) {
+                pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+                if (poll(&pfd, 1, 0) > 0 && drainInput() == 0) break;
+            }
+#endif
         }
-        return count;
+        char key = getKey();
+        leaveRaw();
+        return key;
     }
 };
 
-// 网络通信类
-class NetworkManager {
+// 作用域内保持终端原始模式
+class RawModeScope {
+public:
+    RawModeScope() { TerminalSession::instance().enterRaw(); }
+    ~RawModeScope() { TerminalSession::instance().leaveRaw(); }
+};
+
+// 非阻塞键盘输入检测
+bool checkKeyPress() {
+    TerminalSession& term = TerminalSession::instance();
+    if (term.isRaw()) return term.hasKey();
+    RawModeScope scope;
+    return term.hasKey();
+}
+
+// 获取非阻塞输入
+char getKeyInput() {
+    TerminalSession& term = TerminalSession::instance();
+    if (term.isRaw()) return term.getKey();
+    RawModeScope scope;
+    return term.getKey();
+}
+
+// 按任意键继续，返回按下的键
+char waitAnyKey() {
+    cout << flush;
+    return TerminalSession::instance().waitAnyKey();
+}
+
+// 小端序读写：磁盘文件和网络数据统一使用小端序，与主机字节序无关
+inline void putLE16(unsigned char* p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+inline void putLE32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+inline void putLE64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+inline uint16_t getLE16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t getLE32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+inline uint64_t getLE64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// 只读内存映射文件：按需换入页面，不把整个文件读进内存
+class MappedFile {
 private:
+    const unsigned char* mapped;
+    size_t mappedSize;
 #ifdef _WIN32
-    SOCKET sock;
-    WSADATA wsaData;
-#else
-    int sock;
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
 #endif
-    bool isConnected;
     
 public:
-    NetworkManager() : isConnected(false) {
+    MappedFile() : mapped(nullptr), mappedSize(0) {
 #ifdef _WIN32
-        if (WSAStartup(MAKEWORD(2,2), &wsaData) != 0) {
-            cout << "WSAStartup failed!\n";
-        }
+        fileHandle = INVALID_HANDLE_VALUE;
+        mappingHandle = nullptr;
 #endif
     }
     
-    ~NetworkManager() {
-        disconnect();
-#ifdef _WIN32
-        WSACleanup();
-#endif
-    }
+    ~MappedFile() { close(); }
     
-    bool startServer(int port) {
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool open(const string& path) {
+        close();
 #ifdef _WIN32
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock == INVALID_SOCKET) return false;
-        
-        sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_addr.s_addr = INADDR_ANY;
-        serverAddr.sin_port = htons(port);
-        
-        if (bind(sock, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-            closesocket(sock);
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+            close();
             return false;
         }
-        
-        listen(sock, 5);
-        cout << "服务器已启动，监听端口 " << port << "...\n";
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mappingHandle) {
+            close();
+            return false;
+        }
+        mapped = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (!mapped) {
+            close();
+            return false;
+        }
+        mappedSize = (size_t)fileSize.QuadPart;
 #else
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) return false;
-        
-        sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_addr.s_addr = INADDR_ANY;
-        serverAddr.sin_port = htons(port);
-        
-        if (bind(sock, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-            close(sock);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
             return false;
         }
-        
-        listen(sock, 5);
-        cout << "Server started on port " << port << "...\n";
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        mapped = (const unsigned char*)p;
+        mappedSize = (size_t)st.st_size;
 #endif
-        isConnected = true;
         return true;
     }
     
-    bool connectToServer(const string& ip, int port) {
+    void close() {
 #ifdef _WIN32
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock == INVALID_SOCKET) return false;
-        
-        sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(port);
-        serverAddr.sin_addr.s_addr = inet_addr(ip.c_str());
-        
-        if (connect(sock, (sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-            closesocket(sock);
-            return false;
+        if (mapped) UnmapViewOfFile(mapped);
+        if (mappingHandle) CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (mapped) munmap((void*)mapped, mappedSize);
+#endif
+        mapped = nullptr;
+        mappedSize = 0;
+    }
+    
+    bool isOpen() const { return mapped != nullptr; }
+    const unsigned char* data() const { return mapped; }
+    size_t size() const { return mappedSize; }
+};
+
+// CRC-32(IEEE 802.3)，用于磁盘记录的校验
+struct Crc32Table {
+    uint32_t entries[256];
+    
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
         }
+    }
+};
+
+inline uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+    static const Crc32Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// 写文件并等数据真正落盘；append 为 false 时覆盖原内容
+bool writeFileDurable(const string& path, const string& data, bool append) {
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, FILE_SHARE_READ,
+                           nullptr, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    size_t offset = 0;
+    bool ok = true;
+    while (ok && offset < data.size()) {
+        DWORD written = 0;
+        ok = WriteFile(h, data.data() + offset, (DWORD)min<size_t>(data.size() - offset, 1 << 30),
+                       &written, nullptr) && written > 0;
+        offset += written;
+    }
+    ok = ok && FlushFileBuffers(h);
+    CloseHandle(h);
+    return ok;
 #else
-        sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) return false;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0) return false;
+    size_t offset = 0;
+    bool ok = true;
+    while (ok && offset < data.size()) {
+        ssize_t written = ::write(fd, data.data() + offset, data.size() - offset);
+        if (written > 0) offset += written;
+        else ok = written < 0 && errno == EINTR;
+    }
+    ok = ok && fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// 先写临时文件再改名替换，任何时刻崩溃都只会看到旧文件或新文件
+bool replaceFileDurable(const string& path, const string& data) {
+    string tmpPath = path + ".tmp";
+    if (!writeFileDurable(tmpPath, data, false)) return false;
+#ifdef _WIN32
+    return MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+// 整个文件一次读入，文件不存在时返回 false
+bool readWholeFile(const string& path, string& data) {
+    ifstream inFile(path, ios::binary);
+    if (!inFile) return false;
+    inFile.seekg(0, ios::end);
+    streamoff size = inFile.tellg();
+    inFile.seekg(0, ios::beg);
+    data.resize(size > 0 ? (size_t)size : 0);
+    if (!data.empty()) inFile.read(&data[0], data.size());
+    data.resize((size_t)max<streamsize>(0, inFile.gcount()));
+    return true;
+}
+
+// 按偏移随机写已有文件(数据库就地更新用)
+class WritableFile {
+private:
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+    
+public:
+#ifdef _WIN32
+    WritableFile() : handle(INVALID_HANDLE_VALUE) {}
+#else
+    WritableFile() : fd(-1) {}
+#endif
+    
+    ~WritableFile() { close(); }
+    
+    WritableFile(const WritableFile&) = delete;
+    WritableFile& operator=(const WritableFile&) = delete;
+    
+    bool open(const string& path) {
+        close();
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        return handle != INVALID_HANDLE_VALUE;
+#else
+        fd = ::open(path.c_str(), O_RDWR);
+        return fd >= 0;
+#endif
+    }
+    
+    bool writeAt(uint64_t offset, const void* data, size_t length) {
+#ifdef _WIN32
+        const char* p = (const char*)data;
+        while (length > 0) {
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)offset;
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+            DWORD written = 0;
+            if (!WriteFile(handle, p, (DWORD)min<size_t>(length, 1 << 30), &written, &ov) || written == 0) {
+                return false;
+            }
+            p += written;
+            offset += written;
+            length -= written;
+        }
+        return true;
+#else
+        const char* p = (const char*)data;
+        while (length > 0) {
+            ssize_t written = pwrite(fd, p, length, (off_t)offset);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            p += written;
+            offset += written;
+            length -= written;
+        }
+        return true;
+#endif
+    }
+    
+    bool sync() {
+#ifdef _WIN32
+        return FlushFileBuffers(handle) != 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+    
+    void close() {
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+    }
+};
+
+// FNV-1a 64 位哈希
+inline uint64_t fnv1a64(const char* data, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline uint64_t doubleBits(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+inline double bitsToDouble(uint64_t bits) {
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// 刺激结构体
+struct Stimulus {
+    int visualPosition;  // 0-8 表示3x3网格中的位置
+    char auditoryLetter; // 播放的字母
+};
+
+// xoshiro256** 伪随机数生成器：每局游戏各自持有，可由一个 64 位种子完整复现
+class Xoshiro256 {
+private:
+    uint64_t state[4];
+    
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+    
+public:
+    // splitmix64：把任意种子扩展成均匀的状态，也用来派生子序列种子
+    static uint64_t splitMix64(uint64_t& x) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    
+    // 由基础种子和序号派生互不相关的种子(并行生成时每个任务一个)
+    static uint64_t deriveSeed(uint64_t baseSeed, uint64_t streamIndex) {
+        uint64_t x = baseSeed ^ (streamIndex * 0xD1B54A32D192ED03ULL);
+        return splitMix64(x);
+    }
+    
+    explicit Xoshiro256(uint64_t seed = 1) { reseed(seed); }
+    
+    void reseed(uint64_t seed) {
+        uint64_t x = seed;
+        for (int i = 0; i < 4; i++) {
+            state[i] = splitMix64(x);
+        }
+    }
+    
+    uint64_t next() {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+    
+    // [0, range) 内的整数：用乘法取高位代替取模，不需要拒绝采样
+    // (偏差不超过 range / 2^32，对这里的小范围可以忽略)
+    uint32_t bounded(uint32_t range) {
+        return (uint32_t)(((next() >> 32) * range) >> 32);
+    }
+    
+    // [0, 1) 内的浮点数
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+    
+    // 以 probability 的概率返回 true
+    bool chance(double probability) {
+        return uniform() < probability;
+    }
+};
+
+// 每次新建游戏的默认种子：同一秒内创建的多局游戏也互不相同
+inline uint64_t makeSessionSeed() {
+    static uint64_t counter = 0;
+    uint64_t x = (uint64_t)chrono::steady_clock::now().time_since_epoch().count();
+    x ^= (uint64_t)time(nullptr) << 32;
+    x ^= (uint64_t)random_device{}();
+    x ^= ++counter * 0x9E3779B97F4A7C15ULL;
+    return Xoshiro256::splitMix64(x);
+}
+
+// 每个试次在视觉、听觉上各自与 N 步前匹配的概率
+const double MATCH_PROBABILITY = 0.3;
+
+// 一段刺激序列中的匹配数量(双项匹配不计入单项)
+struct MatchTargets {
+    int visualOnly;
+    int auditoryOnly;
+    int dual;
+    
+    MatchTargets() : visualOnly(0), auditoryOnly(0), dual(0) {}
+    
+    // 按 (N, 试次) 给出固定目标：期望值与按 MATCH_PROBABILITY 独立抽取时相同，
+    // 但每局都精确等于这个值
+    static MatchTargets forSession(int nValue, int trials) {
+        MatchTargets targets;
+        int eligible = max(0, trials - nValue);
+        double p = MATCH_PROBABILITY;
+        targets.dual = (int)(eligible * p * p + 0.5);
+        targets.visualOnly = (int)(eligible * p * (1 - p) + 0.5);
+        targets.auditoryOnly = targets.visualOnly;
+        if (targets.dual + targets.visualOnly + targets.auditoryOnly > eligible) {
+            targets.auditoryOnly = max(0, eligible - targets.dual - targets.visualOnly);
+        }
+        return targets;
+    }
+    
+    // 统计一段已有序列的实际匹配数
+    static MatchTargets count(const Stimulus* seq, int length, int nValue) {
+        MatchTargets counts;
+        for (int i = nValue; i < length; i++) {
+            bool visual = seq[i].visualPosition == seq[i - nValue].visualPosition;
+            bool auditory = seq[i].auditoryLetter == seq[i - nValue].auditoryLetter;
+            counts.dual += visual && auditory;
+            counts.visualOnly += visual && !auditory;
+            counts.auditoryOnly += !visual && auditory;
+        }
+        return counts;
+    }
+    
+    bool operator==(const MatchTargets& other) const {
+        return visualOnly == other.visualOnly && auditoryOnly == other.auditoryOnly && dual == other.dual;
+    }
+};
+
+// 按精确的匹配数量生成序列：先随机排定哪些试次匹配，再逐个填值，
+// 不匹配的试次从其余取值中抽取，保证不会出现计划外的匹配
+bool generateConstrainedSequence(Stimulus* out, int length, int nValue, int gridCells,
+                                 const MatchTargets& targets, Xoshiro256& rng) {
+    int eligible = max(0, length - nValue);
+    if (targets.visualOnly + targets.auditoryOnly + targets.dual > eligible) return false;
+    
+    // 0: 不匹配, 1: 仅视觉, 2: 仅听觉, 3: 双项
+    vector<unsigned char> kinds(eligible, 0);
+    int pos = 0;
+    for (int i = 0; i < targets.dual; i++) kinds[pos++] = 3;
+    for (int i = 0; i < targets.visualOnly; i++) kinds[pos++] = 1;
+    for (int i = 0; i < targets.auditoryOnly; i++) kinds[pos++] = 2;
+    for (int i = eligible - 1; i > 0; i--) {
+        swap(kinds[i], kinds[rng.bounded(i + 1)]);
+    }
+    
+    for (int i = 0; i < length; i++) {
+        if (i < nValue) {
+            out[i].visualPosition = (int)rng.bounded(gridCells);
+            out[i].auditoryLetter = (char)('A' + rng.bounded(26));
+            continue;
+        }
+        const Stimulus& prev = out[i - nValue];
+        unsigned char kind = kinds[i - nValue];
         
-        sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_port = htons(port);
-        inet_pton(AF_INET, ip.c_str(), &serverAddr.sin_addr);
+        uint32_t position = rng.bounded(gridCells - 1);
+        position += (position >= (uint32_t)prev.visualPosition);
+        uint32_t letter = rng.bounded(25);
+        letter += (letter >= (uint32_t)(prev.auditoryLetter - 'A'));
+        
+        out[i].visualPosition = (kind & 1) ? prev.visualPosition : (int)position;
+        out[i].auditoryLetter = (kind & 2) ? prev.auditoryLetter : (char)('A' + letter);
+    }
+    return true;
+}
+
+// 刺激压缩成 2 字节：低 4 位是位置，其上 5 位是字母
+inline uint16_t packStimulus(const Stimulus& stim) {
+    return (uint16_t)(stim.visualPosition | ((stim.auditoryLetter - 'A') << 4));
+}
+
+inline Stimulus unpackStimulus(uint16_t packed) {
+    Stimulus stim;
+    stim.visualPosition = packed & 0x0F;
+    stim.auditoryLetter = (char)('A' + ((packed >> 4) & 0x1F));
+    return stim;
+}
+
+// 预生成的刺激序列库(内存映射)。文件格式(小端序):
+//   文件头 16 字节: "NBSL" | 版本 u32 | 条目数 u32 | 保留 u32
+//   条目表 每条 24 字节: N u16 | 试次 u16 | 序列数 u32 | 数据偏移 u64 |
+//                        仅视觉 u16 | 仅听觉 u16 | 双项 u16 | 保留 u16
+//   数据区: 每条序列 试次 x u16，同一条目的序列连续存放
+class SequenceLibrary {
+private:
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 16;
+    static const size_t ENTRY_SIZE = 24;
+    
+    struct Entry {
+        int nValue;
+        int trials;
+        uint32_t sequenceCount;
+        uint64_t offset;
+    };
+    
+    MappedFile file;
+    map<pair<int, int>, Entry> entries;
+    
+public:
+    static const char* defaultPath() { return "nback_sequences.lib"; }
+    
+    SequenceLibrary() {}
+    explicit SequenceLibrary(const string& path) { open(path); }
+    
+    // 整个进程共用一份映射，第一次使用时打开；局部静态变量的初始化是线程安全的，
+    // 多个线程同时开局也只会打开一次
+    static SequenceLibrary& shared() {
+        static SequenceLibrary library(defaultPath());
+        return library;
+    }
+    
+    bool open(const string& path) {
+        entries.clear();
+        if (!file.open(path)) return false;
+        
+        const unsigned char* data = file.data();
+        if (file.size() < HEADER_SIZE || memcmp(data, "NBSL", 4) != 0 ||
+            getLE32(data + 4) != VERSION) {
+            file.close();
+            return false;
+        }
+        
+        uint32_t entryCount = getLE32(data + 8);
+        if (HEADER_SIZE + (uint64_t)entryCount * ENTRY_SIZE > file.size()) {
+            file.close();
+            return false;
+        }
+        for (uint32_t i = 0; i < entryCount; i++) {
+            const unsigned char* e = data + HEADER_SIZE + i * ENTRY_SIZE;
+            Entry entry;
+            entry.nValue = getLE16(e);
+            entry.trials = getLE16(e + 2);
+            entry.sequenceCount = getLE32(e + 4);
+            entry.offset = getLE64(e + 8);
+            uint64_t bytes = (uint64_t)entry.sequenceCount * entry.trials * 2;
+            if (entry.sequenceCount == 0 || entry.offset + bytes > file.size()) continue;
+            entries[make_pair(entry.nValue, entry.trials)] = entry;
+        }
+        return true;
+    }
+    
+    bool isOpen() const { return file.isOpen(); }
+    
+    // 随机取出一条 (N, 试次) 的序列，库中没有时返回 false
+    bool pick(int nValue, int trials, Xoshiro256& rng, vector<Stimulus>& out) const {
+        auto it = entries.find(make_pair(nValue, trials));
+        if (it == entries.end()) return false;
+        
+        const Entry& entry = it->second;
+        uint32_t index = rng.bounded(entry.sequenceCount);
+        const unsigned char* seq = file.data() + entry.offset + (uint64_t)index * trials * 2;
+        
+        out.resize(trials);
+        for (int i = 0; i < trials; i++) {
+            out[i] = unpackStimulus(getLE16(seq + 2 * i));
+            if (out[i].visualPosition >= 9 || out[i].auditoryLetter > 'Z') return false;
+        }
+        return true;
+    }
+    
+    // 生成序列库：每个 (N, 试次) 组合生成 perEntry 条序列，逐条校验匹配数后写入
+    static bool build(const string& path, int maxN, const vector<int>& trialCounts,
+                      uint32_t perEntry, uint64_t seed) {
+        struct PendingEntry {
+            int nValue;
+            int trials;
+            MatchTargets targets;
+        };
+        vector<PendingEntry> pending;
+        for (int nValue = 1; nValue <= maxN; nValue++) {
+            for (int trials : trialCounts) {
+                if (trials > nValue && trials <= 0xFFFF) {
+                    pending.push_back({nValue, trials, MatchTargets::forSession(nValue, trials)});
+                }
+            }
+        }
+        
+        string tmpPath = path + ".tmp";
+        ofstream outFile(tmpPath, ios::binary | ios::trunc);
+        if (!outFile) return false;
+        
+        vector<unsigned char> header(HEADER_SIZE + pending.size() * ENTRY_SIZE, 0);
+        memcpy(header.data(), "NBSL", 4);
+        putLE32(&header[4], VERSION);
+        putLE32(&header[8], (uint32_t)pending.size());
+        
+        uint64_t offset = header.size();
+        for (size_t i = 0; i < pending.size(); i++) {
+            unsigned char* e = &header[HEADER_SIZE + i * ENTRY_SIZE];
+            putLE16(e, (uint16_t)pending[i].nValue);
+            putLE16(e + 2, (uint16_t)pending[i].trials);
+            putLE32(e + 4, perEntry);
+            putLE64(e + 8, offset);
+            putLE16(e + 16, (uint16_t)pending[i].targets.visualOnly);
+            putLE16(e + 18, (uint16_t)pending[i].targets.auditoryOnly);
+            putLE16(e + 20, (uint16_t)pending[i].targets.dual);
+            offset += (uint64_t)perEntry * pending[i].trials * 2;
+        }
+        outFile.write((const char*)header.data(), header.size());
+        
+        vector<Stimulus> seq;
+        vector<unsigned char> packed;
+        for (size_t i = 0; i < pending.size(); i++) {
+            Xoshiro256 rng(Xoshiro256::deriveSeed(seed, i));
+            const PendingEntry& entry = pending[i];
+            seq.resize(entry.trials);
+            packed.resize((size_t)entry.trials * 2);
+            
+            for (uint32_t k = 0; k < perEntry; k++) {
+                if (!generateConstrainedSequence(seq.data(), entry.trials, entry.nValue, 9,
+                                                 entry.targets, rng) ||
+                    !(MatchTargets::count(seq.data(), entry.trials, entry.nValue) == entry.targets)) {
+                    return false;
+                }
+                for (int t = 0; t < entry.trials; t++) {
+                    putLE16(&packed[2 * t], packStimulus(seq[t]));
+                }
+                outFile.write((const char*)packed.data(), packed.size());
+            }
+        }
+        
+        outFile.close();
+        if (!outFile) return false;
+        remove(path.c_str());
+        return rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+};
+
+// 成就枚举
+enum Achievement {
+    ACH_NOVICE,        // 初学者：完成一次测试
+    ACH_MEMORY_MASTER, // 记忆大师：准确率超过90%
+    ACH_FAST_THINKER,  // 快速思考者：平均响应时间<1000ms
+    ACH_PERFECT_SCORE, // 完美分数：100%准确率
+    ACH_CHALLENGER,    // 挑战者：完成N=5的测试
+    ACH_MULTIPLAYER,   // 多人游戏：完成多人游戏
+    ACH_CONSISTENT,    // 稳定发挥：连续3次准确率>80%
+    ACH_TOTAL_TESTS,   // 测试达人：完成10次测试
+    ACH_DUAL_EXPERT,   // 双项专家：视觉和听觉都>90%
+    ACH_NINJA,         // 记忆忍者：N=3且准确率>85%
+    ACH_COUNT          // 成就总数
+};
+
+// 成就名称和描述
+const string ACHIEVEMENT_NAMES[ACH_COUNT] = {
+    "初学者",
+    "记忆大师",
+    "快速思考者",
+    "完美分数",
+    "挑战者",
+    "多人游戏",
+    "稳定发挥",
+    "测试达人",
+    "双项专家",
+    "记忆忍者"
+};
+
+const string ACHIEVEMENT_DESCS[ACH_COUNT] = {
+    "完成第一次N-Back测试",
+    "总体准确率超过90%",
+    "平均响应时间小于1000毫秒",
+    "获得100%准确率",
+    "完成N=5的高难度测试",
+    "参与多人挑战赛",
+    "连续3次测试准确率超过80%",
+    "完成总计10次测试",
+    "视觉和听觉准确率都超过90%",
+    "在N=3难度下获得85%以上准确率"
+};
+
+// 成就解锁状态：第 i 位对应成就 i
+typedef uint32_t AchievementMask;
+
+constexpr AchievementMask achievementBit(int achievement) {
+    return AchievementMask(1) << achievement;
+}
+
+const AchievementMask ALL_ACHIEVEMENTS = achievementBit(ACH_COUNT) - 1;
+
+constexpr int countAchievements(AchievementMask mask) {
+    int count = 0;
+    for (; mask != 0; mask &= mask - 1) count++;
+    return count;
+}
+
+// 玩家统计
+// 稳定发挥成就看最近几次的准确率
+const size_t RECENT_ACCURACY_COUNT = 3;
+
+struct PlayerStats {
+    string name;
+    int totalTests;
+    int totalTrials;
+    int maxNLevel;
+    double bestAccuracy;
+    double bestResponseTime;
+    AchievementMask achievements;
+    vector<double> recentAccuracies;
+    
+    PlayerStats() : name(""), totalTests(0), totalTrials(0), maxNLevel(0),
+                   bestAccuracy(0), bestResponseTime(10000), achievements(0) {}
+    
+    bool hasAchievement(int achievement) const {
+        return (achievements & achievementBit(achievement)) != 0;
+    }
+    
+    void setAchievement(int achievement, bool unlocked) {
+        if (unlocked) achievements |= achievementBit(achievement);
+        else achievements &= ~achievementBit(achievement);
+    }
+};
+
+// 游戏统计
+struct GameStats {
+    string playerName;
+    int nValue;
+    int totalTrials;
+    int visualHits;
+    int visualFalseAlarms;
+    int visualMisses;
+    int visualCorrectRejections;
+    int auditoryHits;
+    int auditoryFalseAlarms;
+    int auditoryMisses;
+    int auditoryCorrectRejections;
+    double visualAccuracy;
+    double auditoryAccuracy;
+    double overallAccuracy;
+    double responseTimeAvg;          // 所有按键的平均反应时间(毫秒)
+    double visualResponseTimeAvg;    // 视觉按键平均反应时间
+    double auditoryResponseTimeAvg;  // 听觉按键平均反应时间
+    int visualResponseCount;         // 有反应时间记录的视觉按键次数
+    int auditoryResponseCount;       // 有反应时间记录的听觉按键次数
+    
+    GameStats() : playerName(""), nValue(0), totalTrials(0),
+                 visualHits(0), visualFalseAlarms(0), visualMisses(0), visualCorrectRejections(0),
+                 auditoryHits(0), auditoryFalseAlarms(0), auditoryMisses(0), auditoryCorrectRejections(0),
+                 visualAccuracy(0), auditoryAccuracy(0), overallAccuracy(0), responseTimeAvg(0),
+                 visualResponseTimeAvg(0), auditoryResponseTimeAvg(0),
+                 visualResponseCount(0), auditoryResponseCount(0) {}
+    
+    int responseCount() const { return visualResponseCount + auditoryResponseCount; }
+    
+    void calculateAccuracies() {
+        int visualTotal = visualHits + visualMisses + visualFalseAlarms + visualCorrectRejections;
+        int auditoryTotal = auditoryHits + auditoryMisses + auditoryFalseAlarms + auditoryCorrectRejections;
+        
+        if (visualTotal > 0) {
+            visualAccuracy = (visualHits + visualCorrectRejections) * 100.0 / visualTotal;
+        }
+        
+        if (auditoryTotal > 0) {
+            auditoryAccuracy = (auditoryHits + auditoryCorrectRejections) * 100.0 / auditoryTotal;
+        }
+        
+        if (visualTotal + auditoryTotal > 0) {
+            overallAccuracy = (visualHits + visualCorrectRejections + 
+                              auditoryHits + auditoryCorrectRejections) * 100.0 / 
+                              (visualTotal + auditoryTotal);
+        }
+    }
+};
+
+// 玩家信息
+struct Player {
+    string name;
+    GameStats currentStats;
+    PlayerStats careerStats;
+    bool isActive;
+};
+
+// 玩家生涯数据存储：内存映射的定长记录数据库 + 只追加的日志
+//
+// 数据库 player_stats.db(全部小端序，与平台字长、字节序无关)：
+//   文件头 64 字节  "NBPD"、版本、记录长度、文件头 CRC、记录数、记录容量、桶数、索引偏移、记录区偏移、名字区末尾
+//   哈希索引        桶数 x u32，值为记录槽位 + 1(0 表示空桶)，按名字的 FNV-1a 哈希线性探测
+//   记录区          容量 x 96 字节定长记录，新玩家顺序追加，每条记录自带 CRC
+//   名字区          各记录的名字，追加在文件末尾
+// 查找一个玩家只访问一个桶、一条记录和它的名字，进程启动只映射文件，与玩家总数无关。
+//
+// 每次更新只往日志 player_stats.journal 追加该玩家的一条完整记录(按名字覆盖)，后台线程成组提交；
+// 日志攒够一定条数后把改动就地写回数据库(检查点)，记录区满了才整体重建并把容量翻倍。
+// 启动时重放日志，写到一半的尾部记录校验不过，直接截掉
+const char* const PLAYER_STATS_FILE = "player_stats.dat";  // 旧格式，首次启动时导入
+const char* const PLAYER_DB_FILE = "player_stats.db";
+const char* const PLAYER_JOURNAL_FILE = "player_stats.journal";
+const char PLAYER_DB_MAGIC[4] = {'N', 'B', 'P', 'D'};
+const uint32_t PLAYER_DB_VERSION = 1;
+const size_t PLAYER_DB_HEADER_SIZE = 64;
+const size_t PLAYER_DB_RECORD_SIZE = 96;
+const size_t PLAYER_DB_MIN_CAPACITY = 1024;
+const char PLAYER_JOURNAL_MAGIC[4] = {'N', 'B', 'J', 'L'};
+const uint32_t PLAYER_JOURNAL_VERSION = 1;
+const size_t PLAYER_JOURNAL_HEADER_SIZE = 8;
+const int GROUP_COMMIT_WINDOW_MS = 20;       // 成组提交时最多等待的时间
+const size_t GROUP_COMMIT_MAX_RECORDS = 256; // 攒够这么多条立即提交
+const size_t CHECKPOINT_RECORDS = 4096;      // 日志攒够这么多条写回数据库
+
+static_assert(ACH_COUNT <= 16, "成就标记超出数据库记录的预留空间");
+
+// 日志记录：u32 负载长度、u32 负载 CRC，负载为小端序的 PlayerStats 全部字段
+inline void appendPlayerRecord(string& out, const PlayerStats& stats) {
+    size_t nameLength = min<size_t>(stats.name.size(), 0xFFFF);
+    size_t recentCount = min(stats.recentAccuracies.size(), RECENT_ACCURACY_COUNT);
+    size_t payloadLength = 2 + nameLength + 3 * 4 + 2 * 8 + 1 + ACH_COUNT + 1 + recentCount * 8;
+    size_t start = out.size();
+    out.resize(start + 8 + payloadLength);
+    unsigned char* base = (unsigned char*)&out[start];
+    unsigned char* p = base + 8;
+    
+    putLE16(p, (uint16_t)nameLength); p += 2;
+    memcpy(p, stats.name.data(), nameLength); p += nameLength;
+    putLE32(p, (uint32_t)stats.totalTests); p += 4;
+    putLE32(p, (uint32_t)stats.totalTrials); p += 4;
+    putLE32(p, (uint32_t)stats.maxNLevel); p += 4;
+    putLE64(p, doubleBits(stats.bestAccuracy)); p += 8;
+    putLE64(p, doubleBits(stats.bestResponseTime)); p += 8;
+    *p++ = (unsigned char)ACH_COUNT;
+    for (int i = 0; i < ACH_COUNT; i++) *p++ = stats.hasAchievement(i) ? 1 : 0;
+    *p++ = (unsigned char)recentCount;
+    for (size_t i = stats.recentAccuracies.size() - recentCount; i < stats.recentAccuracies.size(); i++) {
+        putLE64(p, doubleBits(stats.recentAccuracies[i])); p += 8;
+    }
+    
+    putLE32(base, (uint32_t)payloadLength);
+    putLE32(base + 4, crc32(base + 8, payloadLength));
+}
+
+// 解析一条日志记录，返回记录总长度；数据不完整或校验失败返回 0
+inline size_t parsePlayerRecord(const unsigned char* data, size_t available, PlayerStats& stats) {
+    if (available < 8) return 0;
+    size_t payloadLength = getLE32(data);
+    if (payloadLength > available - 8) return 0;
+    const unsigned char* p = data + 8;
+    const unsigned char* end = p + payloadLength;
+    if (crc32(p, payloadLength) != getLE32(data + 4)) return 0;
+    
+    if (end - p < 2) return 0;
+    size_t nameLength = getLE16(p); p += 2;
+    if ((size_t)(end - p) < nameLength + 3 * 4 + 2 * 8 + 1) return 0;
+    stats.name.assign((const char*)p, nameLength); p += nameLength;
+    stats.totalTests = (int)getLE32(p); p += 4;
+    stats.totalTrials = (int)getLE32(p); p += 4;
+    stats.maxNLevel = (int)getLE32(p); p += 4;
+    stats.bestAccuracy = bitsToDouble(getLE64(p)); p += 8;
+    stats.bestResponseTime = bitsToDouble(getLE64(p)); p += 8;
+    size_t achievementCount = *p++;
+    if ((size_t)(end - p) < achievementCount) return 0;
+    for (size_t i = 0; i < achievementCount; i++) {
+        if ((int)i < ACH_COUNT) stats.setAchievement((int)i, p[i] != 0);
+    }
+    p += achievementCount;
+    
+    stats.recentAccuracies.clear();
+    if (end - p < 1) return 0;
+    size_t recentCount = *p++;
+    if (recentCount > RECENT_ACCURACY_COUNT || (size_t)(end - p) < recentCount * 8) return 0;
+    for (size_t i = 0; i < recentCount; i++, p += 8) {
+        stats.recentAccuracies.push_back(bitsToDouble(getLE64(p)));
+    }
+    return 8 + payloadLength;
+}
+
+// 数据库定长记录：
+//   0 u64 名字哈希   8 u64 名字偏移   16 u16 名字长度   18 u8 成就数   19 u8 最近准确率个数
+//   20 i32 总测试数  24 i32 总试次数  28 i32 最高 N 值
+//   32 f64 最佳准确率  40 f64 最佳响应时间  48 成就标记(16 字节)
+//   64 f64 x 3 最近准确率  88 u32 名字 CRC  92 u32 前 92 字节的 CRC
+inline void encodeDbRecord(unsigned char* r, const PlayerStats& stats, uint64_t hash, uint64_t nameOffset) {
+    memset(r, 0, PLAYER_DB_RECORD_SIZE);
+    size_t nameLength = min<size_t>(stats.name.size(), 0xFFFF);
+    size_t recentCount = min(stats.recentAccuracies.size(), RECENT_ACCURACY_COUNT);
+    putLE64(r, hash);
+    putLE64(r + 8, nameOffset);
+    putLE16(r + 16, (uint16_t)nameLength);
+    r[18] = (unsigned char)ACH_COUNT;
+    r[19] = (unsigned char)recentCount;
+    putLE32(r + 20, (uint32_t)stats.totalTests);
+    putLE32(r + 24, (uint32_t)stats.totalTrials);
+    putLE32(r + 28, (uint32_t)stats.maxNLevel);
+    putLE64(r + 32, doubleBits(stats.bestAccuracy));
+    putLE64(r + 40, doubleBits(stats.bestResponseTime));
+    for (int i = 0; i < ACH_COUNT; i++) r[48 + i] = stats.hasAchievement(i) ? 1 : 0;
+    size_t first = stats.recentAccuracies.size() - recentCount;
+    for (size_t i = 0; i < recentCount; i++) {
+        putLE64(r + 64 + i * 8, doubleBits(stats.recentAccuracies[first + i]));
+    }
+    putLE32(r + 88, crc32((const unsigned char*)stats.name.data(), nameLength));
+    putLE32(r + 92, crc32(r, 92));
+}
+
+// 文件头 CRC：计算时 CRC 字段本身按 0 处理
+inline uint32_t playerDbHeaderCrc(const unsigned char* header) {
+    unsigned char copy[PLAYER_DB_HEADER_SIZE];
+    memcpy(copy, header, PLAYER_DB_HEADER_SIZE);
+    putLE32(copy + 12, 0);
+    return crc32(copy, PLAYER_DB_HEADER_SIZE);
+}
+
+class PlayerStatsStore {
+private:
+    // 日志里(含待提交)的记录，优先于数据库；seq 用来判断检查点之后是否又被改过
+    struct OverlayEntry {
+        PlayerStats stats;
+        uint64_t seq;
+    };
+    
+    mutex stateMutex;                   // 保护以下所有状态
+    condition_variable wake;            // 有新记录或要退出时唤醒写线程
+    condition_variable committed;       // 一批记录落盘后通知 flush()
+    map<string, OverlayEntry> overlay;
+    string pending;                     // 待提交的日志记录
+    size_t pendingRecords;
+    size_t journalRecords;              // 日志里已提交的记录数
+    uint64_t appendedSeq;
+    uint64_t committedSeq;
+    bool loaded;
+    bool stopping;
+    bool databaseRejected;              // 数据库文件无法识别又没能移开，不在其上检查点
+    thread writer;
+    
+    // 数据库映射和解析好的文件头；只有写线程(持锁)会重新映射
+    MappedFile db;
+    uint64_t recordCount;
+    uint64_t recordCapacity;
+    uint64_t bucketCount;
+    uint64_t indexOffset;
+    uint64_t recordsOffset;
+    uint64_t namesEnd;
+    
+    static const size_t NOT_FOUND = (size_t)-1;
+    
+    PlayerStatsStore() : pendingRecords(0), journalRecords(0), appendedSeq(0), committedSeq(0),
+                         loaded(false), stopping(false), databaseRejected(false),
+                         recordCount(0), recordCapacity(0),
+                         bucketCount(0), indexOffset(0), recordsOffset(0), namesEnd(0) {}
+    
+    ~PlayerStatsStore() {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (writer.joinable()) writer.join();
+    }
+    
+    static string journalHeader() {
+        string header(PLAYER_JOURNAL_HEADER_SIZE, '\0');
+        memcpy(&header[0], PLAYER_JOURNAL_MAGIC, 4);
+        putLE32((unsigned char*)&header[4], PLAYER_JOURNAL_VERSION);
+        return header;
+    }
+    
+    // 映射数据库并检查文件头，各区域必须落在文件范围内
+    bool openDatabase() {
+        recordCount = recordCapacity = bucketCount = 0;
+        if (!db.open(PLAYER_DB_FILE)) return false;
+        const unsigned char* h = db.data();
+        uint64_t size = db.size();
+        bool valid = size >= PLAYER_DB_HEADER_SIZE && memcmp(h, PLAYER_DB_MAGIC, 4) == 0;
+        if (valid) {
+            valid = getLE32(h + 4) == PLAYER_DB_VERSION && getLE32(h + 8) == PLAYER_DB_RECORD_SIZE &&
+                    getLE32(h + 12) == playerDbHeaderCrc(h);
+        }
+        if (valid) {
+            recordCount = getLE64(h + 16);
+            recordCapacity = getLE64(h + 24);
+            bucketCount = getLE64(h + 32);
+            indexOffset = getLE64(h + 40);
+            recordsOffset = getLE64(h + 48);
+            namesEnd = getLE64(h + 56);
+            valid = recordCount <= recordCapacity && bucketCount > recordCapacity &&
+                    (bucketCount & (bucketCount - 1)) == 0 &&
+                    indexOffset + bucketCount * 4 <= recordsOffset &&
+                    recordsOffset + recordCapacity * PLAYER_DB_RECORD_SIZE <= namesEnd && namesEnd <= size;
+        }
+        if (!valid) {
+            db.close();
+            recordCount = recordCapacity = bucketCount = 0;
+        }
+        return valid;
+    }
+    
+    const unsigned char* recordAt(size_t slot) const {
+        return db.data() + recordsOffset + slot * PLAYER_DB_RECORD_SIZE;
+    }
+    
+    // 解码一条记录，校验失败(损坏)时返回 false
+    bool decodeRecord(size_t slot, PlayerStats& stats) const {
+        const unsigned char* r = recordAt(slot);
+        uint64_t nameOffset = getLE64(r + 8);
+        size_t nameLength = getLE16(r + 16);
+        if (nameOffset < recordsOffset || nameOffset + nameLength > namesEnd) return false;
+        const unsigned char* name = db.data() + nameOffset;
+        if (getLE32(r + 92) != crc32(r, 92) || getLE32(r + 88) != crc32(name, nameLength)) {
+            return false;
+        }
+        stats.name.assign((const char*)name, nameLength);
+        stats.totalTests = (int)getLE32(r + 20);
+        stats.totalTrials = (int)getLE32(r + 24);
+        stats.maxNLevel = (int)getLE32(r + 28);
+        stats.bestAccuracy = bitsToDouble(getLE64(r + 32));
+        stats.bestResponseTime = bitsToDouble(getLE64(r + 40));
+        size_t achievementCount = min<size_t>(r[18], 16);
+        for (size_t i = 0; i < achievementCount && (int)i < ACH_COUNT; i++) {
+            stats.setAchievement((int)i, r[48 + i] != 0);
+        }
+        stats.recentAccuracies.clear();
+        size_t recentCount = min<size_t>(r[19], RECENT_ACCURACY_COUNT);
+        for (size_t i = 0; i < recentCount; i++) {
+            stats.recentAccuracies.push_back(bitsToDouble(getLE64(r + 64 + i * 8)));
+        }
+        return true;
+    }
+    
+    // 在哈希索引里找名字对应的槽位
+    size_t findSlot(const string& name, uint64_t hash) const {
+        if (!db.isOpen()) return NOT_FOUND;
+        const unsigned char* index = db.data() + indexOffset;
+        uint64_t mask = bucketCount - 1;
+        for (uint64_t probe = 0, i = hash & mask; probe < bucketCount; probe++, i = (i + 1) & mask) {
+            uint32_t entry = getLE32(index + i * 4);
+            if (entry == 0) return NOT_FOUND;
+            size_t slot = entry - 1;
+            // 槽位超出记录数说明是未完成的检查点留下的，跳过
+            if (slot >= recordCount) continue;
+            const unsigned char* r = recordAt(slot);
+            if (getLE64(r) != hash || getLE16(r + 16) != name.size()) continue;
+            uint64_t nameOffset = getLE64(r + 8);
+            if (nameOffset + name.size() <= namesEnd &&
+                memcmp(db.data() + nameOffset, name.data(), name.size()) == 0) {
+                return slot;
+            }
+        }
+        return NOT_FOUND;
+    }
+    
+    // 按给定容量生成完整的数据库文件
+    static string buildDatabase(const vector<PlayerStats>& all, uint64_t capacity) {
+        uint64_t buckets = 1;
+        while (buckets < capacity * 2) buckets <<= 1;
+        uint64_t indexAt = PLAYER_DB_HEADER_SIZE;
+        uint64_t recordsAt = indexAt + buckets * 4;
+        uint64_t namesAt = recordsAt + capacity * PLAYER_DB_RECORD_SIZE;
+        
+        size_t nameBytes = 0;
+        for (const PlayerStats& stats : all) nameBytes += min<size_t>(stats.name.size(), 0xFFFF);
+        string data(namesAt + nameBytes, '\0');
+        unsigned char* base = (unsigned char*)&data[0];
+        
+        uint64_t nameOffset = namesAt;
+        for (size_t slot = 0; slot < all.size(); slot++) {
+            const PlayerStats& stats = all[slot];
+            size_t nameLength = min<size_t>(stats.name.size(), 0xFFFF);
+            uint64_t hash = fnv1a64(stats.name.data(), nameLength);
+            encodeDbRecord(base + recordsAt + slot * PLAYER_DB_RECORD_SIZE, stats, hash, nameOffset);
+            memcpy(base + nameOffset, stats.name.data(), nameLength);
+            nameOffset += nameLength;
+            
+            for (uint64_t i = hash & (buckets - 1); ; i = (i + 1) & (buckets - 1)) {
+                if (getLE32(base + indexAt + i * 4) == 0) {
+                    putLE32(base + indexAt + i * 4, (uint32_t)(slot + 1));
+                    break;
+                }
+            }
+        }
+        
+        memcpy(base, PLAYER_DB_MAGIC, 4);
+        putLE32(base + 4, PLAYER_DB_VERSION);
+        putLE32(base + 8, PLAYER_DB_RECORD_SIZE);
+        putLE64(base + 16, all.size());
+        putLE64(base + 24, capacity);
+        putLE64(base + 32, buckets);
+        putLE64(base + 40, indexAt);
+        putLE64(base + 48, recordsAt);
+        putLE64(base + 56, nameOffset);
+        putLE32(base + 12, playerDbHeaderCrc(base));
+        return data;
+    }
+    
+    // 现有记录加上改动，按翻倍的容量生成新的数据库文件内容
+    string rebuiltDatabase(const vector<PlayerStats>& changes) const {
+        // 损坏的记录被跳过，槽位号和 all 的下标不再对应，按名字找新位置
+        vector<PlayerStats> all;
+        unordered_map<string, size_t> positions;
+        all.reserve(recordCount + changes.size());
+        for (size_t slot = 0; slot < recordCount; slot++) {
+            PlayerStats stats;
+            if (decodeRecord(slot, stats) && positions.emplace(stats.name, all.size()).second) {
+                all.push_back(stats);
+            }
+        }
+        for (const PlayerStats& stats : changes) {
+            auto it = positions.find(stats.name);
+            if (it != positions.end()) {
+                all[it->second] = stats;
+            } else {
+                positions.emplace(stats.name, all.size());
+                all.push_back(stats);
+            }
+        }
+        return buildDatabase(all, max<uint64_t>(PLAYER_DB_MIN_CAPACITY, all.size() * 2));
+    }
+    
+    // 映射中的文件不能被替换(Windows)，换文件期间先关闭映射
+    bool replaceDatabase(const string& data) {
+        db.close();
+        bool ok = replaceFileDurable(PLAYER_DB_FILE, data);
+        openDatabase();
+        return ok;
+    }
+    
+    // 重建数据库。调用时不持锁
+    bool rebuildDatabase(const vector<PlayerStats>& changes) {
+        string data = rebuiltDatabase(changes);
+        lock_guard<mutex> lock(stateMutex);
+        return replaceDatabase(data);
+    }
+    
+    // 检查点：已有玩家就地覆盖记录，新玩家追加到记录区和名字区。调用时不持锁；
+    // 这些名字仍在 overlay 里，读者不会去看正在改写的记录
+    bool checkpoint(const vector<PlayerStats>& changes) {
+        if (databaseRejected) return false;
+        vector<pair<size_t, const PlayerStats*>> updates;
+        vector<const PlayerStats*> additions;
+        for (const PlayerStats& stats : changes) {
+            size_t slot = findSlot(stats.name, fnv1a64(stats.name.data(), stats.name.size()));
+            if (slot == NOT_FOUND) additions.push_back(&stats);
+            else updates.push_back(make_pair(slot, &stats));
+        }
+        if (!db.isOpen() || recordCount + additions.size() > recordCapacity) {
+            return rebuildDatabase(changes);
+        }
+        
+        WritableFile file;
+        if (!file.open(PLAYER_DB_FILE)) return false;
+        unsigned char record[PLAYER_DB_RECORD_SIZE];
+        bool ok = true;
+        for (const auto& update : updates) {
+            const PlayerStats& stats = *update.second;
+            const unsigned char* old = recordAt(update.first);
+            encodeDbRecord(record, stats, getLE64(old), getLE64(old + 8));
+            ok = ok && file.writeAt(recordsOffset + update.first * PLAYER_DB_RECORD_SIZE,
+                                    record, PLAYER_DB_RECORD_SIZE);
+        }
+        
+        uint64_t count = recordCount;
+        uint64_t nameEnd = namesEnd;
+        uint64_t mask = bucketCount - 1;
+        const unsigned char* index = db.data() + indexOffset;
+        vector<uint64_t> claimed;  // 本次写入的桶(不依赖映射立即看到写入)
+        for (const PlayerStats* stats : additions) {
+            size_t nameLength = min<size_t>(stats->name.size(), 0xFFFF);
+            uint64_t hash = fnv1a64(stats->name.data(), nameLength);
+            encodeDbRecord(record, *stats, hash, nameEnd);
+            ok = ok && file.writeAt(nameEnd, stats->name.data(), nameLength) &&
+                 file.writeAt(recordsOffset + count * PLAYER_DB_RECORD_SIZE, record, PLAYER_DB_RECORD_SIZE);
+            
+            uint64_t i = hash & mask;
+            while ((getLE32(index + i * 4) != 0 && getLE32(index + i * 4) - 1 < recordCount) ||
+                   find(claimed.begin(), claimed.end(), i) != claimed.end()) {
+                i = (i + 1) & mask;
+            }
+            unsigned char entry[4];
+            putLE32(entry, (uint32_t)(count + 1));
+            ok = ok && file.writeAt(indexOffset + i * 4, entry, 4);
+            claimed.push_back(i);
+            count++;
+            nameEnd += nameLength;
+        }
+        
+        // 记录和索引落盘后再更新文件头，中途崩溃时旧文件头仍然自洽
+        unsigned char header[PLAYER_DB_HEADER_SIZE];
+        memcpy(header, db.data(), PLAYER_DB_HEADER_SIZE);
+        putLE64(header + 16, count);
+        putLE64(header + 56, nameEnd);
+        putLE32(header + 12, playerDbHeaderCrc(header));
+        ok = ok && file.sync() && file.writeAt(0, header, PLAYER_DB_HEADER_SIZE) && file.sync();
+        file.close();
+        
+        lock_guard<mutex> lock(stateMutex);
+        db.close();
+        openDatabase();
+        return ok;
+    }
+    
+    // 导入旧格式文件(逐字段写的主机字节序、无文件头)：一次读入，逐条检查长度，
+    // 截断或明显不合理的记录及其后的内容丢弃
+    static bool loadLegacySnapshot(vector<PlayerStats>& all) {
+        string data;
+        if (!readWholeFile(PLAYER_STATS_FILE, data)) return false;
+        
+        const size_t fixedSize = 3 * sizeof(int) + 2 * sizeof(double) + ACH_COUNT * sizeof(int);
+        const char* p = data.data();
+        size_t remaining = data.size();
+        while (remaining >= sizeof(size_t)) {
+            size_t nameLen;
+            memcpy(&nameLen, p, sizeof(nameLen));
+            if (nameLen > 0xFFFF || remaining - sizeof(nameLen) < nameLen + fixedSize) break;
+            p += sizeof(nameLen);
+            
+            PlayerStats stats;
+            stats.name.assign(p, nameLen);
+            p += nameLen;
+            memcpy(&stats.totalTests, p, sizeof(int)); p += sizeof(int);
+            memcpy(&stats.totalTrials, p, sizeof(int)); p += sizeof(int);
+            memcpy(&stats.maxNLevel, p, sizeof(int)); p += sizeof(int);
+            memcpy(&stats.bestAccuracy, p, sizeof(double)); p += sizeof(double);
+            memcpy(&stats.bestResponseTime, p, sizeof(double)); p += sizeof(double);
+            for (int i = 0; i < ACH_COUNT; i++) {
+                int unlocked;
+                memcpy(&unlocked, p, sizeof(int)); p += sizeof(int);
+                stats.setAchievement(i, unlocked != 0);
+            }
+            remaining -= sizeof(nameLen) + nameLen + fixedSize;
+            
+            all.push_back(stats);
+        }
+        return true;
+    }
+    
+    // 重放日志，遇到不完整或校验失败的记录就停下并截掉后面的内容
+    void replayJournal() {
+        string data;
+        readWholeFile(PLAYER_JOURNAL_FILE, data);
+        
+        // 日志不存在或文件头不对时重新建一个空日志，之后的追加才能被识别
+        const unsigned char* base = (const unsigned char*)data.data();
+        if (data.size() < PLAYER_JOURNAL_HEADER_SIZE || memcmp(base, PLAYER_JOURNAL_MAGIC, 4) != 0 ||
+            getLE32(base + 4) != PLAYER_JOURNAL_VERSION) {
+            replaceFileDurable(PLAYER_JOURNAL_FILE, journalHeader());
+            return;
+        }
+        
+        size_t offset = PLAYER_JOURNAL_HEADER_SIZE;
+        while (offset < data.size()) {
+            PlayerStats stats;
+            size_t used = parsePlayerRecord(base + offset, data.size() - offset, stats);
+            if (used == 0) break;
+            overlay[stats.name] = {stats, 0};
+            journalRecords++;
+            offset += used;
+        }
+        if (offset < data.size()) {
+            data.resize(offset);
+            replaceFileDurable(PLAYER_JOURNAL_FILE, data);
+        }
+    }
+    
+    // 数据库文件存在但无法识别(文件头损坏、版本或记录大小不符)时移到一边并报告，
+    // 否则第一次检查点会只用日志里的玩家重建数据库，覆盖掉其余所有玩家
+    void setAsideUnreadableDatabase() {
+        ifstream existing(PLAYER_DB_FILE, ios::binary);
+        if (!existing || existing.peek() == EOF) return;
+        existing.close();
+        string aside = string(PLAYER_DB_FILE) + ".corrupt";
+        remove(aside.c_str());
+        if (rename(PLAYER_DB_FILE, aside.c_str()) == 0) {
+            cerr << "警告: " << PLAYER_DB_FILE << " 无法识别，已移到 " << aside << "\n";
+        } else {
+            databaseRejected = true;
+            cerr << "警告: " << PLAYER_DB_FILE << " 无法识别且无法移开，玩家数据只写入日志\n";
+        }
+    }
+    
+    void ensureLoaded() {
+        if (loaded) return;
+        loaded = true;
+        if (!openDatabase()) {
+            setAsideUnreadableDatabase();
+            vector<PlayerStats> legacy;
+            if (loadLegacySnapshot(legacy)) {
+                replaceDatabase(buildDatabase(legacy, max<uint64_t>(PLAYER_DB_MIN_CAPACITY, legacy.size() * 2)));
+            }
+        }
+        replayJournal();
+    }
+    
+    // 后台写线程：成组提交日志，攒够后做检查点
+    void writerLoop() {
+        unique_lock<mutex> lock(stateMutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || pendingRecords > 0; });
+            if (pendingRecords == 0) break;
+            
+            // 稍等片刻，让同一时间段的更新合成一次写入和一次 fsync
+            if (!stopping) {
+                wake.wait_for(lock, chrono::milliseconds(GROUP_COMMIT_WINDOW_MS), [this] {
+                    return stopping || pendingRecords >= GROUP_COMMIT_MAX_RECORDS;
+                });
+            }
+            string batch;
+            batch.swap(pending);
+            size_t batchRecords = pendingRecords;
+            uint64_t batchSeq = appendedSeq;
+            pendingRecords = 0;
+            
+            lock.unlock();
+            bool ok = writeFileDurable(PLAYER_JOURNAL_FILE, batch, true);
+            lock.lock();
+            
+            if (!ok) {
+                // 写失败(如磁盘满)时保留记录，稍后重试
+                pending.insert(0, batch);
+                pendingRecords += batchRecords;
+                if (!stopping) wake.wait_for(lock, chrono::seconds(1));
+                else break;
+                continue;
+            }
+            journalRecords += batchRecords;
+            committedSeq = batchSeq;
+            committed.notify_all();
+            
+            if (journalRecords >= CHECKPOINT_RECORDS) {
+                vector<PlayerStats> changes;
+                changes.reserve(overlay.size());
+                for (const auto& entry : overlay) changes.push_back(entry.second.stats);
+                uint64_t checkpointSeq = appendedSeq;
+                
+                lock.unlock();
+                // 只有本线程写日志，拷贝之后的新记录还在 pending 里，清空日志不会丢数据
+                bool done = checkpoint(changes) &&
+                            replaceFileDurable(PLAYER_JOURNAL_FILE, journalHeader());
+                lock.lock();
+                if (done) {
+                    journalRecords = 0;
+                    for (auto it = overlay.begin(); it != overlay.end();) {
+                        if (it->second.seq <= checkpointSeq) it = overlay.erase(it);
+                        else ++it;
+                    }
+                }
+            }
+        }
+    }
+    
+public:
+    static PlayerStatsStore& instance() {
+        static PlayerStatsStore store;
+        return store;
+    }
+    
+    // 打开存储：映射数据库、重放日志，不读取全部玩家
+    void open() {
+        lock_guard<mutex> lock(stateMutex);
+        ensureLoaded();
+    }
+    
+    // 关闭存储：提交全部记录、停止写线程并解除映射，之后可重新 open()(如换了工作目录)
+    void close() {
+        flush();
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (writer.joinable()) writer.join();
+        
+        lock_guard<mutex> lock(stateMutex);
+        overlay.clear();
+        pending.clear();
+        pendingRecords = journalRecords = 0;
+        loaded = stopping = databaseRejected = false;
+        db.close();
+        recordCount = recordCapacity = bucketCount = 0;
+    }
+    
+    // 批量导入：用给定玩家直接生成数据库并清空日志(存储未打开时调用)
+    static bool importDatabase(const vector<PlayerStats>& all) {
+        string data = buildDatabase(all, max<uint64_t>(PLAYER_DB_MIN_CAPACITY, all.size() * 2));
+        return replaceFileDurable(PLAYER_DB_FILE, data) &&
+               replaceFileDurable(PLAYER_JOURNAL_FILE, journalHeader());
+    }
+    
+    // 按名字查找玩家，只读取该玩家的索引桶和记录
+    bool get(const string& name, PlayerStats& stats) {
+        lock_guard<mutex> lock(stateMutex);
+        ensureLoaded();
+        auto it = overlay.find(name);
+        if (it != overlay.end()) {
+            stats = it->second.stats;
+            return true;
+        }
+        size_t slot = findSlot(name, fnv1a64(name.data(), name.size()));
+        return slot != NOT_FOUND && decodeRecord(slot, stats);
+    }
+    
+    // 记录一个玩家的新状态：只在内存中排队，不等落盘
+    void put(const PlayerStats& stats) {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            ensureLoaded();
+            appendedSeq++;
+            overlay[stats.name] = {stats, appendedSeq};
+            appendPlayerRecord(pending, stats);
+            pendingRecords++;
+            if (!writer.joinable()) writer = thread(&PlayerStatsStore::writerLoop, this);
+        }
+        wake.notify_one();
+    }
+    
+    // 等待已排队的记录全部落盘
+    void flush() {
+        unique_lock<mutex> lock(stateMutex);
+        if (!writer.joinable()) return;
+        uint64_t target = appendedSeq;
+        wake.notify_one();
+        committed.wait(lock, [this, target] { return committedSeq >= target; });
+    }
+    
+    // 离线遍历(报表用)：数据库记录数和日志中较新的玩家；之后 readSlot 只读映射，
+    // 可在多个线程里同时调用，期间不能再 put
+    size_t databaseRecords() {
+        lock_guard<mutex> lock(stateMutex);
+        ensureLoaded();
+        return (size_t)recordCount;
+    }
+    
+    vector<PlayerStats> journalPlayers() {
+        lock_guard<mutex> lock(stateMutex);
+        ensureLoaded();
+        vector<PlayerStats> result;
+        result.reserve(overlay.size());
+        for (const auto& entry : overlay) result.push_back(entry.second.stats);
+        return result;
+    }
+    
+    bool readSlot(size_t slot, PlayerStats& stats) const {
+        return slot < recordCount && decodeRecord(slot, stats);
+    }
+};
+
+// 全局排行榜：每个 N 值、每项指标一张榜，记录每个玩家在该 N 值下的最好成绩
+//
+// 榜单用带子树大小的树堆(treap)维护：更新和查名次都是 O(log n)，前 k 名 O(k + log n)。
+// 只有刷新个人最好成绩时才追加一条日志到 nback_leaderboard.journal
+// (文件头 "NBLB"、u32 版本，记录为 u32 负载长度、u32 负载 CRC、负载：u16 N、u8 指标、f64 成绩、u16 名字长度、名字)，
+// 启动时重放日志重建榜单，过期记录太多时整体重写一次
+const char* const LEADERBOARD_FILE = "nback_leaderboard.journal";
+const char LEADERBOARD_MAGIC[4] = {'N', 'B', 'L', 'B'};
+const uint32_t LEADERBOARD_VERSION = 1;
+const size_t LEADERBOARD_HEADER_SIZE = 8;
+const size_t LEADERBOARD_TOP_COUNT = 10;
+
+enum BoardMetric {
+    BOARD_ACCURACY = 0,      // 总体准确率，越高越好
+    BOARD_RESPONSE_TIME,     // 平均反应时间，越低越好
+    BOARD_METRIC_COUNT
+};
+
+const char* const BOARD_METRIC_NAMES[BOARD_METRIC_COUNT] = {"总体准确率", "反应时间"};
+
+// 按 (键, 名字) 升序排列的树堆，节点放在数组里按下标相连，删除的节点回收复用
+class RankTree {
+private:
+    struct Node {
+        double key;
+        string name;
+        uint64_t priority;
+        int left;
+        int right;
+        size_t size;
+    };
+    vector<Node> nodes;
+    vector<int> freeNodes;
+    int root;
+    Xoshiro256 rng;
+    
+    static bool less(double keyA, const string& nameA, double keyB, const string& nameB) {
+        return keyA < keyB || (keyA == keyB && nameA < nameB);
+    }
+    
+    size_t sizeOf(int t) const { return t < 0 ? 0 : nodes[t].size; }
+    
+    void update(int t) { nodes[t].size = 1 + sizeOf(nodes[t].left) + sizeOf(nodes[t].right); }
+    
+    // 把 t 分成小于 (key, name) 的部分和其余部分
+    void split(int t, double key, const string& name, int& lo, int& hi) {
+        if (t < 0) {
+            lo = hi = -1;
+            return;
+        }
+        if (less(nodes[t].key, nodes[t].name, key, name)) {
+            split(nodes[t].right, key, name, nodes[t].right, hi);
+            lo = t;
+        } else {
+            split(nodes[t].left, key, name, lo, nodes[t].left);
+            hi = t;
+        }
+        update(t);
+    }
+    
+    // 合并两棵树，a 中所有键都小于 b
+    int merge(int a, int b) {
+        if (a < 0) return b;
+        if (b < 0) return a;
+        if (nodes[a].priority > nodes[b].priority) {
+            nodes[a].right = merge(nodes[a].right, b);
+            update(a);
+            return a;
+        }
+        nodes[b].left = merge(a, nodes[b].left);
+        update(b);
+        return b;
+    }
+    
+public:
+    RankTree() : root(-1), rng(0x6E6261636B) {}
+    
+    size_t size() const { return sizeOf(root); }
+    
+    // 由已按顺序排好的元素一次建树：随机优先级下按栈构造笛卡尔树，O(n)
+    void build(const vector<pair<double, string>>& sorted) {
+        nodes.assign(sorted.size(), Node());
+        freeNodes.clear();
+        vector<int> rightSpine;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            int t = (int)i;
+            nodes[t].key = sorted[i].first;
+            nodes[t].name = sorted[i].second;
+            nodes[t].priority = rng.next();
+            nodes[t].right = -1;
+            int last = -1;
+            while (!rightSpine.empty() && nodes[rightSpine.back()].priority < nodes[t].priority) {
+                last = rightSpine.back();
+                rightSpine.pop_back();
+            }
+            nodes[t].left = last;
+            if (!rightSpine.empty()) nodes[rightSpine.back()].right = t;
+            rightSpine.push_back(t);
+        }
+        root = rightSpine.empty() ? -1 : rightSpine.front();
+        // 子节点下标可能比父节点大也可能小，按后序补上子树大小
+        vector<pair<int, bool>> stack;
+        if (root >= 0) stack.push_back(make_pair(root, false));
+        while (!stack.empty()) {
+            pair<int, bool> top = stack.back();
+            stack.pop_back();
+            int t = top.first;
+            if (top.second) {
+                update(t);
+                continue;
+            }
+            stack.push_back(make_pair(t, true));
+            if (nodes[t].left >= 0) stack.push_back(make_pair(nodes[t].left, false));
+            if (nodes[t].right >= 0) stack.push_back(make_pair(nodes[t].right, false));
+        }
+    }
+    
+    void insert(double key, const string& name) {
+        int t;
+        if (!freeNodes.empty()) {
+            t = freeNodes.back();
+            freeNodes.pop_back();
+        } else {
+            t = (int)nodes.size();
+            nodes.push_back(Node());
+        }
+        nodes[t].key = key;
+        nodes[t].name = name;
+        nodes[t].priority = rng.next();
+        nodes[t].left = nodes[t].right = -1;
+        nodes[t].size = 1;
+        
+        int lo, hi;
+        split(root, key, name, lo, hi);
+        root = merge(merge(lo, t), hi);
+    }
+    
+    // 删除 (key, name)，不存在时返回 false
+    bool erase(double key, const string& name) {
+        int lo, mid, hi;
+        split(root, key, name, lo, hi);
+        // hi 中最小的元素就是要找的节点时，把它单独分出来
+        int t = hi;
+        while (t >= 0 && nodes[t].left >= 0) t = nodes[t].left;
+        bool found = t >= 0 && nodes[t].key == key && nodes[t].name == name;
+        if (found) {
+            split(hi, key, name + '\0', mid, hi);
+            freeNodes.push_back(mid);
+            nodes[mid].name.clear();
+        }
+        root = merge(lo, hi);
+        return found;
+    }
+    
+    // 小于 (key, name) 的元素个数，即从 0 开始的名次
+    size_t countBefore(double key, const string& name) const {
+        size_t count = 0;
+        int t = root;
+        while (t >= 0) {
+            if (less(nodes[t].key, nodes[t].name, key, name)) {
+                count += sizeOf(nodes[t].left) + 1;
+                t = nodes[t].right;
+            } else {
+                t = nodes[t].left;
+            }
+        }
+        return count;
+    }
+    
+    // 按顺序取前 k 个元素：中序遍历，只走到第 k 个为止
+    void top(size_t k, vector<pair<string, double>>& out) const {
+        vector<int> path;
+        int t = root;
+        while ((t >= 0 || !path.empty()) && out.size() < k) {
+            if (t >= 0) {
+                path.push_back(t);
+                t = nodes[t].left;
+            } else {
+                t = path.back();
+                path.pop_back();
+                out.push_back(make_pair(nodes[t].name, nodes[t].key));
+                t = nodes[t].right;
+            }
+        }
+    }
+};
+
+// 各 N 值下每个玩家的最好成绩：N 值 -> 玩家 -> 成绩
+typedef map<int, map<string, double>> LevelScores;
+
+class GlobalLeaderboard {
+private:
+    // 一张榜：树里的键已按"越小越好"规范化，scores 记录每个玩家当前在榜上的键
+    struct Board {
+        RankTree tree;
+        map<string, double> scores;
+    };
+    map<int, Board> boards[BOARD_METRIC_COUNT];
+    size_t journalRecords;
+    size_t liveEntries;
+    bool loaded;
+    bool replaying;   // 重放日志时只更新 scores，重放完再一次建树
+    
+    GlobalLeaderboard() : journalRecords(0), liveEntries(0), loaded(false), replaying(false) {}
+    
+    static double toKey(BoardMetric metric, double score) {
+        return metric == BOARD_ACCURACY ? -score : score;
+    }
+    
+    static double fromKey(BoardMetric metric, double key) {
+        return metric == BOARD_ACCURACY ? -key : key;
+    }
+    
+    static string journalHeader() {
+        string header(LEADERBOARD_HEADER_SIZE, '\0');
+        memcpy(&header[0], LEADERBOARD_MAGIC, 4);
+        putLE32((unsigned char*)&header[4], LEADERBOARD_VERSION);
+        return header;
+    }
+    
+    static void appendRecord(string& out, int n, BoardMetric metric, const string& name, double score) {
+        size_t nameLength = min<size_t>(name.size(), 0xFFFF);
+        size_t payloadLength = 2 + 1 + 8 + 2 + nameLength;
+        size_t start = out.size();
+        out.resize(start + 8 + payloadLength);
+        unsigned char* base = (unsigned char*)&out[start];
+        unsigned char* p = base + 8;
+        putLE16(p, (uint16_t)n); p += 2;
+        *p++ = (unsigned char)metric;
+        putLE64(p, doubleBits(score)); p += 8;
+        putLE16(p, (uint16_t)nameLength); p += 2;
+        memcpy(p, name.data(), nameLength);
+        putLE32(base, (uint32_t)payloadLength);
+        putLE32(base + 4, crc32(base + 8, payloadLength));
+    }
+    
+    // 成绩比榜上已有的好才更新，返回是否更新
+    bool apply(int n, BoardMetric metric, const string& name, double score) {
+        Board& board = boards[metric][n];
+        double key = toKey(metric, score);
+        auto it = board.scores.find(name);
+        if (it != board.scores.end()) {
+            if (key >= it->second) return false;
+            if (!replaying) board.tree.erase(it->second, name);
+            it->second = key;
+        } else {
+            board.scores[name] = key;
+            liveEntries++;
+        }
+        if (!replaying) board.tree.insert(key, name);
+        return true;
+    }
+    
+    // 重放日志；写到一半的尾部截掉，过期记录超过有效记录时整体重写
+    void load() {
+        string data;
+        readWholeFile(LEADERBOARD_FILE, data);
+        const unsigned char* base = (const unsigned char*)data.data();
+        if (data.size() < LEADERBOARD_HEADER_SIZE || memcmp(base, LEADERBOARD_MAGIC, 4) != 0 ||
+            getLE32(base + 4) != LEADERBOARD_VERSION) {
+            replaceFileDurable(LEADERBOARD_FILE, journalHeader());
+            return;
+        }
+        
+        size_t offset = LEADERBOARD_HEADER_SIZE;
+        replaying = true;
+        while (offset + 8 <= data.size()) {
+            size_t payloadLength = getLE32(base + offset);
+            const unsigned char* p = base + offset + 8;
+            if (payloadLength < 13 || payloadLength > data.size() - offset - 8 ||
+                crc32(p, payloadLength) != getLE32(base + offset + 4) ||
+                13 + (size_t)getLE16(p + 11) != payloadLength || p[2] >= BOARD_METRIC_COUNT) {
+                break;
+            }
+            apply(getLE16(p), (BoardMetric)p[2], string((const char*)p + 13, getLE16(p + 11)),
+                  bitsToDouble(getLE64(p + 3)));
+            journalRecords++;
+            offset += 8 + payloadLength;
+        }
+        replaying = false;
+        buildTrees();
+        
+        if (journalRecords > 2 * liveEntries + 1024) {
+            compact();
+        } else if (offset < data.size()) {
+            data.resize(offset);
+            replaceFileDurable(LEADERBOARD_FILE, data);
+        }
+    }
+    
+    // 按 scores 一次建好所有榜的树
+    void buildTrees() {
+        for (int m = 0; m < BOARD_METRIC_COUNT; m++) {
+            for (auto& entry : boards[m]) {
+                Board& board = entry.second;
+                vector<pair<double, string>> sorted;
+                sorted.reserve(board.scores.size());
+                for (const auto& score : board.scores) sorted.push_back(make_pair(score.second, score.first));
+                sort(sorted.begin(), sorted.end());
+                board.tree.build(sorted);
+            }
+        }
+    }
+    
+    // 只保留每个玩家当前的成绩，重写日志
+    void compact() {
+        string data = journalHeader();
+        for (int m = 0; m < BOARD_METRIC_COUNT; m++) {
+            for (const auto& board : boards[m]) {
+                for (const auto& entry : board.second.scores) {
+                    appendRecord(data, board.first, (BoardMetric)m, entry.first,
+                                 fromKey((BoardMetric)m, entry.second));
+                }
+            }
+        }
+        if (replaceFileDurable(LEADERBOARD_FILE, data)) journalRecords = liveEntries;
+    }
+    
+    const Board* find(int n, BoardMetric metric) {
+        open();
+        auto it = boards[metric].find(n);
+        return it == boards[metric].end() ? nullptr : &it->second;
+    }
+    
+public:
+    static GlobalLeaderboard& instance() {
+        static GlobalLeaderboard leaderboard;
+        return leaderboard;
+    }
+    
+    GlobalLeaderboard(const GlobalLeaderboard&) = delete;
+    GlobalLeaderboard& operator=(const GlobalLeaderboard&) = delete;
+    
+    void open() {
+        if (loaded) return;
+        loaded = true;
+        load();
+    }
+    
+    // 提交一局成绩，刷新了个人在该 N 值下的最好成绩才写日志
+    void submit(const GameStats& stats) {
+        open();
+        string records;
+        size_t count = 0;
+        if (apply(stats.nValue, BOARD_ACCURACY, stats.playerName, stats.overallAccuracy)) {
+            appendRecord(records, stats.nValue, BOARD_ACCURACY, stats.playerName, stats.overallAccuracy);
+            count++;
+        }
+        if (stats.responseCount() > 0 &&
+            apply(stats.nValue, BOARD_RESPONSE_TIME, stats.playerName, stats.responseTimeAvg)) {
+            appendRecord(records, stats.nValue, BOARD_RESPONSE_TIME, stats.playerName, stats.responseTimeAvg);
+            count++;
+        }
+        if (count > 0 && writeFileDurable(LEADERBOARD_FILE, records, true)) {
+            journalRecords += count;
+        }
+    }
+    
+    // 用给定的最好成绩整体替换全部榜单并重写日志(回放历史时使用)
+    bool rebuild(const LevelScores scores[BOARD_METRIC_COUNT]) {
+        loaded = true;
+        liveEntries = 0;
+        for (int m = 0; m < BOARD_METRIC_COUNT; m++) {
+            boards[m].clear();
+            for (const auto& level : scores[m]) {
+                Board& board = boards[m][level.first];
+                for (const auto& entry : level.second) {
+                    board.scores[entry.first] = toKey((BoardMetric)m, entry.second);
+                    liveEntries++;
+                }
+            }
+        }
+        buildTrees();
+        journalRecords = 0;
+        compact();
+        return journalRecords == liveEntries;
+    }
+    
+    // 玩家在榜上的名次(从 1 开始)，不在榜上返回 0
+    size_t rank(int n, BoardMetric metric, const string& name) {
+        const Board* board = find(n, metric);
+        if (!board) return 0;
+        auto it = board->scores.find(name);
+        return it == board->scores.end() ? 0 : board->tree.countBefore(it->second, name) + 1;
+    }
+    
+    size_t size(int n, BoardMetric metric) {
+        const Board* board = find(n, metric);
+        return board ? board->tree.size() : 0;
+    }
+    
+    // 前 k 名的名字和成绩
+    vector<pair<string, double>> top(int n, BoardMetric metric, size_t k) {
+        vector<pair<string, double>> result;
+        const Board* board = find(n, metric);
+        if (board) {
+            board->tree.top(k, result);
+            for (auto& entry : result) entry.second = fromKey(metric, entry.second);
+        }
+        return result;
+    }
+    
+    // 已有成绩的 N 值
+    vector<int> levels(BoardMetric metric) {
+        open();
+        vector<int> result;
+        for (const auto& board : boards[metric]) result.push_back(board.first);
+        return result;
+    }
+};
+
+// 成就判定时可用的信息：已更新的生涯统计、本局成绩、是否多人对局
+struct AchievementContext {
+    const PlayerStats& career;
+    const GameStats& game;
+    bool multiplayer;
+};
+
+// 成就规则：每条规则是一个类型，id 为对应的成就，test() 判断本局后是否达成
+struct NoviceRule {
+    static constexpr Achievement id = ACH_NOVICE;
+    static bool test(const AchievementContext& c) { return c.career.totalTests == 1; }
+};
+
+struct MemoryMasterRule {
+    static constexpr Achievement id = ACH_MEMORY_MASTER;
+    static bool test(const AchievementContext& c) { return c.game.overallAccuracy >= 90.0; }
+};
+
+struct FastThinkerRule {
+    static constexpr Achievement id = ACH_FAST_THINKER;
+    static bool test(const AchievementContext& c) {
+        return c.game.responseCount() > 0 && c.game.responseTimeAvg <= 1000.0;
+    }
+};
+
+struct PerfectScoreRule {
+    static constexpr Achievement id = ACH_PERFECT_SCORE;
+    static bool test(const AchievementContext& c) { return c.game.overallAccuracy >= 99.9; }
+};
+
+struct ChallengerRule {
+    static constexpr Achievement id = ACH_CHALLENGER;
+    static bool test(const AchievementContext& c) { return c.game.nValue >= 5; }
+};
+
+struct MultiplayerRule {
+    static constexpr Achievement id = ACH_MULTIPLAYER;
+    static bool test(const AchievementContext& c) { return c.multiplayer; }
+};
+
+struct ConsistentRule {
+    static constexpr Achievement id = ACH_CONSISTENT;
+    static bool test(const AchievementContext& c) {
+        const vector<double>& recent = c.career.recentAccuracies;
+        if (recent.size() < RECENT_ACCURACY_COUNT) return false;
+        for (double accuracy : recent) {
+            if (accuracy < 80.0) return false;
+        }
+        return true;
+    }
+};
+
+struct TotalTestsRule {
+    static constexpr Achievement id = ACH_TOTAL_TESTS;
+    static bool test(const AchievementContext& c) { return c.career.totalTests >= 10; }
+};
+
+struct DualExpertRule {
+    static constexpr Achievement id = ACH_DUAL_EXPERT;
+    static bool test(const AchievementContext& c) {
+        return c.game.visualAccuracy >= 90.0 && c.game.auditoryAccuracy >= 90.0;
+    }
+};
+
+struct NinjaRule {
+    static constexpr Achievement id = ACH_NINJA;
+    static bool test(const AchievementContext& c) {
+        return c.game.nValue >= 3 && c.game.overallAccuracy >= 85.0;
+    }
+};
+
+// 规则表：编译期展开成一串按位运算，已解锁的成就不再求值
+template <typename... Rules>
+struct AchievementRuleSet {
+    static constexpr AchievementMask mask = (AchievementMask(0) | ... | achievementBit(Rules::id));
+    static constexpr int size = sizeof...(Rules);
+    
+    // 返回本次新达成的成就位
+    static AchievementMask evaluate(AchievementMask unlocked, const AchievementContext& context) {
+        AchievementMask pending = mask & ~unlocked;
+        if (pending == 0) return 0;
+        return (AchievementMask(0) | ... | fire<Rules>(pending, context));
+    }
+    
+private:
+    template <typename Rule>
+    static AchievementMask fire(AchievementMask pending, const AchievementContext& context) {
+        constexpr AchievementMask bit = achievementBit(Rule::id);
+        return (pending & bit) && Rule::test(context) ? bit : 0;
+    }
+};
+
+typedef AchievementRuleSet<NoviceRule, MemoryMasterRule, FastThinkerRule, PerfectScoreRule,
+                           ChallengerRule, MultiplayerRule, ConsistentRule, TotalTestsRule,
+                           DualExpertRule, NinjaRule> AchievementRules;
+
+static_assert(AchievementRules::mask == ALL_ACHIEVEMENTS, "每个成就都需要一条规则");
+static_assert(countAchievements(AchievementRules::mask) == AchievementRules::size, "成就规则重复");
+
+// 成就系统类
+class AchievementSystem {
+private:
+    map<string, PlayerStats> allPlayers;
+    bool persistent; // 为 false 时只在内存中更新，不写盘也不计时(模拟、回放时使用，可各线程各用一个)
+    
+public:
+    AchievementSystem() : persistent(true) {}
+    
+    void setPersistent(bool enabled) { persistent = enabled; }
+    
+    // 打开存储并清空本地缓存，之后按需逐个读取玩家
+    void loadPlayerStats() {
+        PlayerStatsStore::instance().open();
+        allPlayers.clear();
+    }
+    
+    // 保存一个玩家：追加一条日志记录，实际写盘在后台成组完成
+    void savePlayerStats(const PlayerStats& stats) {
+        allPlayers[stats.name] = stats;
+        if (persistent) {
+            ScopedTimer timer(PROBE_SAVE_STATS);
+            PlayerStatsStore::instance().put(stats);
+        }
+    }
+    
+    // 已读取或更新过的全部玩家
+    const map<string, PlayerStats>& cachedPlayers() const { return allPlayers; }
+    
+    PlayerStats* getPlayerStats(const string& name) {
+        auto it = allPlayers.find(name);
+        if (it != allPlayers.end()) return &it->second;
+        
+        PlayerStats stats;
+        if (!persistent || !PlayerStatsStore::instance().get(name, stats)) {
+            stats = PlayerStats();
+            stats.name = name;
+        }
+        return &(allPlayers[name] = stats);
+    }
+    
+    // 按规则表判定本局后新达成的成就，返回新成就的名称
+    vector<string> checkAchievements(PlayerStats& stats, const GameStats& gameStats, bool multiplayer = false) {
+        vector<string> newAchievements;
+        AchievementContext context = {stats, gameStats, multiplayer};
+        AchievementMask unlocked = AchievementRules::evaluate(stats.achievements, context);
+        if (unlocked == 0) return newAchievements;
+        
+        stats.achievements |= unlocked;
+        for (int i = 0; i < ACH_COUNT; i++) {
+            if (unlocked & achievementBit(i)) newAchievements.push_back(ACHIEVEMENT_NAMES[i]);
+        }
+        savePlayerStats(stats);
+        return newAchievements;
+    }
+    
+    void updatePlayerStats(PlayerStats& stats, const GameStats& gameStats) {
+        stats.totalTests++;
+        stats.totalTrials += gameStats.totalTrials;
+        
+        if (gameStats.nValue > stats.maxNLevel) {
+            stats.maxNLevel = gameStats.nValue;
+        }
+        
+        if (gameStats.overallAccuracy > stats.bestAccuracy) {
+            stats.bestAccuracy = gameStats.overallAccuracy;
+        }
+        
+        if (gameStats.responseCount() > 0 && gameStats.responseTimeAvg < stats.bestResponseTime) {
+            stats.bestResponseTime = gameStats.responseTimeAvg;
+        }
+        
+        stats.recentAccuracies.push_back(gameStats.overallAccuracy);
+        if (stats.recentAccuracies.size() > RECENT_ACCURACY_COUNT) {
+            stats.recentAccuracies.erase(stats.recentAccuracies.begin());
+        }
+        
+        savePlayerStats(stats);
+        if (persistent) {
+            GlobalLeaderboard::instance().submit(gameStats);
+        }
+    }
+    
+    void displayPlayerAchievements(const string& playerName) {
+        PlayerStats* stats = getPlayerStats(playerName);
+        
+        clearScreen();
+        cout << "========================================\n";
+        cout << "      " << playerName << " 的成就系统\n";
+        cout << "========================================\n";
+        
+        cout << "\n统计信息:\n";
+        cout << "总测试次数: " << stats->totalTests << "\n";
+        cout << "总试次数量: " << stats->totalTrials << "\n";
+        cout << "最高N值: " << stats->maxNLevel << "\n";
+        cout << "最佳准确率: " << fixed << setprecision(1) << stats->bestAccuracy << "%\n";
+        cout << "最佳响应时间: " << fixed << setprecision(0) << stats->bestResponseTime << "ms\n";
+        
+        cout << "\n已获得成就 (" << getAchievementCount(*stats) << "/" << ACH_COUNT << "):\n";
+        cout << "----------------------------------------\n";
+        
+        for (int i = 0; i < ACH_COUNT; i++) {
+            if (stats->hasAchievement(i)) {
+                cout << "[V] " << ACHIEVEMENT_NAMES[i] << "\n";
+                cout << "    " << ACHIEVEMENT_DESCS[i] << "\n\n";
+            }
+        }
+        
+        cout << "\n未获得成就:\n";
+        cout << "----------------------------------------\n";
+        for (int i = 0; i < ACH_COUNT; i++) {
+            if (!stats->hasAchievement(i)) {
+                cout << "[ ] " << ACHIEVEMENT_NAMES[i] << "\n";
+                cout << "    " << ACHIEVEMENT_DESCS[i] << "\n\n";
+            }
+        }
+        
+        cout << "========================================\n";
+        cout << "按任意键返回...";
+        waitAnyKey();
+    }
+    
+    int getAchievementCount(const PlayerStats& stats) {
+        return countAchievements(stats.achievements);
+    }
+};
+
+// 套接字句柄及跨平台的基本操作
+#ifdef _WIN32
+typedef SOCKET SocketHandle;
+const SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+#else
+typedef int SocketHandle;
+const SocketHandle INVALID_SOCKET_HANDLE = -1;
+#endif
+
+inline void closeSocket(SocketHandle s) {
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+inline bool setSocketNonBlocking(SocketHandle s) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// 上一次套接字调用是否只是暂时无数据/缓冲区满
+inline bool socketWouldBlock() {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+    return err == WSAEWOULDBLOCK || err == WSAEINTR;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// accept 失败后是否接着接受下一个：被信号打断，或对端在接受之前就断开了
+inline bool acceptShouldRetry() {
+#ifdef _WIN32
+    int err = WSAGetLastError();
+    return err == WSAEINTR || err == WSAECONNRESET;
+#else
+    return errno == EINTR || errno == ECONNABORTED || errno == EPROTO;
+#endif
+}
+
+// 对端已关闭时返回错误而不是触发 SIGPIPE
+inline long socketSend(SocketHandle s, const char* data, size_t length) {
+#ifdef _WIN32
+    return send(s, data, (int)length, 0);
+#elif defined(MSG_NOSIGNAL)
+    return send(s, data, length, MSG_NOSIGNAL);
+#else
+    return send(s, data, length, 0);
+#endif
+}
+
+inline long socketRecv(SocketHandle s, char* buffer, size_t length) {
+#ifdef _WIN32
+    return recv(s, buffer, (int)length, 0);
+#else
+    return recv(s, buffer, length, 0);
+#endif
+}
+
+// 就绪事件，token 是注册时给的标识
+struct PollerEvent {
+    uint64_t token;
+    bool readable;
+    bool writable;
+    bool hangup;
+};
+
+// 套接字就绪通知：Linux 用 epoll，其他平台退回 poll/WSAPoll
+class SocketPoller {
+private:
+#ifdef __linux__
+    int epollFd;
+    vector<epoll_event> readyBuffer;
+#else
+#ifdef _WIN32
+    vector<WSAPOLLFD> pollFds;
+#else
+    vector<pollfd> pollFds;
+#endif
+    vector<uint64_t> tokens;
+    
+    int indexOf(SocketHandle s) const {
+        for (size_t i = 0; i < pollFds.size(); i++) {
+            if (pollFds[i].fd == s) return (int)i;
+        }
+        return -1;
+    }
+#endif
+    
+public:
+    SocketPoller() {
+#ifdef __linux__
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        readyBuffer.resize(64);
+#endif
+    }
+    
+    ~SocketPoller() {
+#ifdef __linux__
+        if (epollFd >= 0) close(epollFd);
+#endif
+    }
+    
+    SocketPoller(const SocketPoller&) = delete;
+    SocketPoller& operator=(const SocketPoller&) = delete;
+    
+    bool add(SocketHandle s, uint64_t token, bool wantWrite) {
+#ifdef __linux__
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.u64 = token;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, s, &ev) == 0;
+#else
+        pollFds.push_back({});
+        pollFds.back().fd = s;
+        pollFds.back().events = POLLIN | (wantWrite ? POLLOUT : 0);
+        tokens.push_back(token);
+        return true;
+#endif
+    }
+    
+    void modify(SocketHandle s, uint64_t token, bool wantWrite) {
+#ifdef __linux__
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.u64 = token;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, s, &ev);
+#else
+        int i = indexOf(s);
+        if (i >= 0) {
+            pollFds[i].events = POLLIN | (wantWrite ? POLLOUT : 0);
+            tokens[i] = token;
+        }
+#endif
+    }
+    
+    void remove(SocketHandle s) {
+#ifdef __linux__
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, s, NULL);
+#else
+        int i = indexOf(s);
+        if (i >= 0) {
+            pollFds[i] = pollFds.back();
+            pollFds.pop_back();
+            tokens[i] = tokens.back();
+            tokens.pop_back();
+        }
+#endif
+    }
+    
+    // 等待就绪事件(毫秒，-1 表示一直等)，返回事件数
+    int wait(vector<PollerEvent>& events, int timeoutMs) {
+        events.clear();
+#ifdef __linux__
+        int ready = epoll_wait(epollFd, readyBuffer.data(), (int)readyBuffer.size(), timeoutMs);
+        for (int i = 0; i < ready; i++) {
+            uint32_t flags = readyBuffer[i].events;
+            events.push_back({readyBuffer[i].data.u64,
+                              (flags & EPOLLIN) != 0,
+                              (flags & EPOLLOUT) != 0,
+                              (flags & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) != 0});
+        }
+        // 缓冲区被填满说明连接多，下次多取一些
+        if (ready == (int)readyBuffer.size()) readyBuffer.resize(readyBuffer.size() * 2);
+#else
+        if (pollFds.empty()) {
+            if (timeoutMs > 0) this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+            return 0;
+        }
+#ifdef _WIN32
+        int ready = WSAPoll(pollFds.data(), (ULONG)pollFds.size(), timeoutMs);
+#else
+        int ready = poll(pollFds.data(), pollFds.size(), timeoutMs);
+#endif
+        for (size_t i = 0; ready > 0 && i < pollFds.size(); i++) {
+            short flags = pollFds[i].revents;
+            if (flags == 0) continue;
+            events.push_back({tokens[i],
+                              (flags & POLLIN) != 0,
+                              (flags & POLLOUT) != 0,
+                              (flags & (POLLHUP | POLLERR | POLLNVAL)) != 0});
+        }
+#endif
+        return (int)events.size();
+    }
+    
+    // 可供 poll 等待的句柄(Linux 上是 epoll 描述符本身)，没有时返回 -1
+    int waitHandle() const {
+#ifdef __linux__
+        return epollFd;
+#else
+        return -1;
+#endif
+    }
+};
+
+// 线路协议：每帧 8 字节小端帧头(负载长度 u32、消息类型 u16、协议版本 u16)，后接定长字段的负载
+const size_t WIRE_HEADER_SIZE = 8;
+const uint16_t WIRE_VERSION = 1;
+const uint32_t WIRE_MAX_PAYLOAD = 64 * 1024;
+
+enum MessageType {
+    MSG_JOIN = 1,       // 客户端 -> 主机：玩家名
+    MSG_SETTINGS,       // 主机 -> 客户端：本局参数
+    MSG_STIMULUS,       // 主机 -> 客户端：一个试次的刺激
+    MSG_RESPONSE,       // 客户端 -> 主机：该试次的按键和反应时间
+    MSG_SCORE,          // 主机 -> 客户端：该试次的判定和累计成绩
+    MSG_LEADERBOARD     // 主机 -> 客户端：最终排行榜
+};
+
+// 组装一帧：帧头和负载写在同一块缓冲区里，一次系统调用发出
+class WireWriter {
+private:
+    string frame;
+    
+public:
+    explicit WireWriter(MessageType type) : frame(WIRE_HEADER_SIZE, '\0') {
+        putLE16((unsigned char*)&frame[4], (uint16_t)type);
+        putLE16((unsigned char*)&frame[6], WIRE_VERSION);
+    }
+    
+    void u8(uint8_t v) { frame.push_back((char)v); }
+    void u16(uint16_t v) { size_t at = grow(2); putLE16((unsigned char*)&frame[at], v); }
+    void u32(uint32_t v) { size_t at = grow(4); putLE32((unsigned char*)&frame[at], v); }
+    void i32(int32_t v) { u32((uint32_t)v); }
+    void u64(uint64_t v) { size_t at = grow(8); putLE64((unsigned char*)&frame[at], v); }
+    
+    // 字符串：u8 长度 + 字节，超过 255 字节截断
+    void str(const string& s) {
+        size_t length = min<size_t>(s.size(), 255);
+        u8((uint8_t)length);
+        frame.append(s, 0, length);
+    }
+    
+    // 回填负载长度，返回完整的帧
+    const string& finish() {
+        putLE32((unsigned char*)&frame[0], (uint32_t)(frame.size() - WIRE_HEADER_SIZE));
+        return frame;
+    }
+    
+private:
+    size_t grow(size_t bytes) {
+        size_t at = frame.size();
+        frame.resize(at + bytes);
+        return at;
+    }
+};
+
+// 按顺序读取负载字段，越界时置 ok() 为 false 并返回 0
+class WireReader {
+private:
+    const unsigned char* data;
+    size_t length;
+    size_t pos;
+    bool valid;
+    
+    const unsigned char* take(size_t bytes) {
+        if (!valid || length - pos < bytes) {
+            valid = false;
+            return NULL;
+        }
+        const unsigned char* p = data + pos;
+        pos += bytes;
+        return p;
+    }
+    
+public:
+    WireReader(const unsigned char* payload, size_t payloadLength)
+        : data(payload), length(payloadLength), pos(0), valid(true) {}
+    
+    uint8_t u8() { const unsigned char* p = take(1); return p ? p[0] : 0; }
+    uint16_t u16() { const unsigned char* p = take(2); return p ? getLE16(p) : 0; }
+    uint32_t u32() { const unsigned char* p = take(4); return p ? getLE32(p) : 0; }
+    int32_t i32() { return (int32_t)u32(); }
+    uint64_t u64() { const unsigned char* p = take(8); return p ? getLE64(p) : 0; }
+    
+    string str() {
+        size_t n = u8();
+        const unsigned char* p = take(n);
+        return p ? string((const char*)p, n) : string();
+    }
+    
+    bool ok() const { return valid; }
+};
+
+// 收到的一条消息，payload 指向接收缓冲区，只在回调期间有效
+struct WireMessage {
+    MessageType type;
+    const unsigned char* payload;
+    uint32_t length;
+    
+    WireReader reader() const { return WireReader(payload, length); }
+    
+    // 解码成具体的消息结构，类型不符或负载不完整时返回 false
+    template <typename T>
+    bool decode(T& msg) const {
+        if (type != T::TYPE) return false;
+        WireReader in = reader();
+        return msg.read(in) && in.ok();
+    }
+};
+
+// 接收用的环形缓冲区：recv 直接写进空闲区，完整的帧就地解析
+class ByteRing {
+private:
+    vector<unsigned char> buffer;
+    size_t head;  // 读位置(累计字节数)
+    size_t tail;  // 写位置(累计字节数)
+    
+public:
+    explicit ByteRing(size_t capacity = 4096) : buffer(capacity), head(0), tail(0) {}
+    
+    size_t size() const { return tail - head; }
+    
+    // 返回可直接写入的连续空间，满了就扩容(容量保持 2 的幂)
+    unsigned char* writeSpace(size_t& available) {
+        size_t capacity = buffer.size();
+        if (size() == capacity) {
+            vector<unsigned char> larger(capacity * 2);
+            for (size_t i = 0; i < capacity; i++) {
+                larger[i] = buffer[(head + i) & (capacity - 1)];
+            }
+            buffer.swap(larger);
+            head = 0;
+            tail = capacity;
+            capacity = buffer.size();
+        }
+        size_t start = tail & (capacity - 1);
+        size_t free = capacity - size();
+        available = min(free, capacity - start);
+        return &buffer[start];
+    }
+    
+    void commit(size_t bytes) { tail += bytes; }
+    
+    // 读取从 offset 开始的 bytes 字节：连续时直接返回内部指针，跨过缓冲区末尾时才拷到 scratch
+    const unsigned char* peek(size_t offset, size_t bytes, vector<unsigned char>& scratch) const {
+        size_t capacity = buffer.size();
+        size_t start = (head + offset) & (capacity - 1);
+        if (start + bytes <= capacity) return &buffer[start];
+        scratch.resize(bytes);
+        size_t first = capacity - start;
+        memcpy(&scratch[0], &buffer[start], first);
+        memcpy(&scratch[first], &buffer[0], bytes - first);
+        return &scratch[0];
+    }
+    
+    void consume(size_t bytes) {
+        head += bytes;
+        if (head == tail) head = tail = 0;
+    }
+};
+
+// 网络事件的接收者
+class NetworkListener {
+public:
+    virtual ~NetworkListener() {}
+    virtual void onClientConnected(int) {}
+    virtual void onMessage(int clientId, const WireMessage& msg) = 0;
+    virtual void onClientDisconnected(int) {}
+};
+
+// 单个连接(服务器端的每个客户端，或客户端连到主机的那一个)
+struct ClientConnection {
+    int id;
+    SocketHandle sock;
+    string address;
+    ByteRing inBuffer;  // 已收到但还没解析的字节
+    string outBuffer;   // 待发送的字节，从 outOffset 开始
+    size_t outOffset;
+    bool wantWrite;     // 是否在等可写事件
+    bool closing;       // 已决定断开，等本轮处理结束后回收
+};
+
+// 网络通信类
+class NetworkManager {
+private:
+    SocketHandle sock;          // 服务器模式下的监听套接字
+#ifdef _WIN32
+    WSADATA wsaData;
+#endif
+    bool isConnected;
+    bool serverMode;
+    bool listenPaused;          // 描述符用尽，暂停接受新连接直到有连接断开
+    
+    // 所有连接在一个线程里由 poller 驱动；客户端模式下只有连到主机的一条
+    SocketPoller poller;
+    map<int, ClientConnection> clients;
+    int nextClientId;
+    vector<int> closingClients;
+    NetworkListener* listener;
+    vector<PollerEvent> readyEvents;
+    vector<unsigned char> scratch;
+    
+    static const uint64_t LISTEN_TOKEN = 0;
+    static const size_t MAX_PENDING_OUTPUT = 4 << 20;
+    
+    ClientConnection& addConnection(SocketHandle s, const string& address) {
+        setSocketNonBlocking(s);
+        int noDelay = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+        
+        int id = nextClientId++;
+        ClientConnection& conn = clients[id];
+        conn.id = id;
+        conn.sock = s;
+        conn.address = address;
+        conn.outOffset = 0;
+        conn.wantWrite = false;
+        conn.closing = false;
+        poller.add(s, (uint64_t)id, false);
+        return conn;
+    }
+    
+    void acceptClients() {
+        while (true) {
+            sockaddr_in clientAddr;
+            socklen_t addrLen = sizeof(clientAddr);
+            SocketHandle clientSock = accept(sock, (sockaddr*)&clientAddr, &addrLen);
+            if (clientSock == INVALID_SOCKET_HANDLE) {
+                if (acceptShouldRetry()) continue;
+                // 除了没有更多待接受的连接，其余多是描述符用尽(EMFILE/ENFILE)：
+                // 监听套接字会一直可读，水平触发下 service() 会空转，先不再关注它
+                if (!socketWouldBlock()) {
+                    poller.remove(sock);
+                    listenPaused = true;
+                }
+                break;
+            }
+            
+            char ipText[INET_ADDRSTRLEN] = "?";
+            inet_ntop(AF_INET, &clientAddr.sin_addr, ipText, sizeof(ipText));
+            ClientConnection& conn = addConnection(clientSock,
+                string(ipText) + ":" + to_string(ntohs(clientAddr.sin_port)));
+            if (listener) listener->onClientConnected(conn.id);
+        }
+    }
+    
+    // 读空内核缓冲区并分发完整的帧，对端关闭或出错时返回 false
+    bool readFrom(ClientConnection& conn) {
+        bool open = true;
+        while (true) {
+            size_t available;
+            unsigned char* space = conn.inBuffer.writeSpace(available);
+            long bytesRead = socketRecv(conn.sock, (char*)space, available);
+            if (bytesRead > 0) {
+                conn.inBuffer.commit(bytesRead);
+                if (bytesRead < (long)available) break;
+            } else {
+                open = bytesRead < 0 && socketWouldBlock();
+                break;
+            }
+        }
+        // 对端关闭前发来的消息仍然要处理
+        return dispatchFrames(conn) && open;
+    }
+    
+    // 解析环形缓冲区里的完整帧，帧头非法时返回 false
+    bool dispatchFrames(ClientConnection& conn) {
+        ScopedTimer timer(PROBE_NET_RECV);
+        unsigned char header[WIRE_HEADER_SIZE];
+        while (!conn.closing && conn.inBuffer.size() >= WIRE_HEADER_SIZE) {
+            const unsigned char* h = conn.inBuffer.peek(0, WIRE_HEADER_SIZE, scratch);
+            memcpy(header, h, WIRE_HEADER_SIZE);
+            uint32_t length = getLE32(header);
+            uint16_t type = getLE16(header + 4);
+            if (getLE16(header + 6) != WIRE_VERSION || length > WIRE_MAX_PAYLOAD ||
+                type < MSG_JOIN || type > MSG_LEADERBOARD) {
+                return false;
+            }
+            if (conn.inBuffer.size() < WIRE_HEADER_SIZE + length) break;
+            
+            WireMessage msg;
+            msg.type = (MessageType)type;
+            msg.length = length;
+            msg.payload = conn.inBuffer.peek(WIRE_HEADER_SIZE, length, scratch);
+            if (listener) listener->onMessage(conn.id, msg);
+            conn.inBuffer.consume(WIRE_HEADER_SIZE + length);
+        }
+        return true;
+    }
+    
+    // 尽量发出待发送数据，发不完就等可写事件，出错时返回 false
+    bool flushOutput(ClientConnection& conn) {
+        while (conn.outOffset < conn.outBuffer.size()) {
+            long sent = socketSend(conn.sock, conn.outBuffer.data() + conn.outOffset,
+                                   conn.outBuffer.size() - conn.outOffset);
+            if (sent > 0) {
+                conn.outOffset += sent;
+            } else if (sent < 0 && socketWouldBlock()) {
+                break;
+            } else {
+                return false;
+            }
+        }
+        if (conn.outOffset == conn.outBuffer.size()) {
+            conn.outBuffer.clear();
+            conn.outOffset = 0;
+        }
+        bool pending = !conn.outBuffer.empty();
+        if (pending != conn.wantWrite) {
+            conn.wantWrite = pending;
+            poller.modify(conn.sock, (uint64_t)conn.id, pending);
+        }
+        return true;
+    }
+    
+    bool queueFrame(ClientConnection& conn, const string& frame) {
+        if (conn.closing) return false;
+        // 对端长期不读时不再无限堆积
+        if (conn.outBuffer.size() - conn.outOffset > MAX_PENDING_OUTPUT) return false;
+        conn.outBuffer += frame;
+        return conn.wantWrite ? true : flushOutput(conn);
+    }
+    
+    // 回收本轮标记为断开的连接
+    void reapClosed() {
+        bool closedAny = false;
+        while (!closingClients.empty()) {
+            int id = closingClients.back();
+            closingClients.pop_back();
+            auto it = clients.find(id);
+            if (it == clients.end()) continue;
+            poller.remove(it->second.sock);
+            closeSocket(it->second.sock);
+            clients.erase(it);
+            closedAny = true;
+            if (listener) listener->onClientDisconnected(id);
+        }
+        // 释放了描述符，恢复接受新连接
+        if (listenPaused && closedAny) listenPaused = !poller.add(sock, LISTEN_TOKEN, false);
+    }
+    
+    // 超过上限的帧对端会当作协议错误断开连接，不发
+    static bool frameFits(const string& frame) {
+        return frame.size() <= WIRE_HEADER_SIZE + WIRE_MAX_PAYLOAD;
+    }
+    
+    bool sendFrameTo(int clientId, const string& frame) {
+        if (!frameFits(frame)) return false;
+        auto it = clients.find(clientId);
+        if (it == clients.end()) return false;
+        if (!queueFrame(it->second, frame)) {
+            dropClient(clientId);
+            return false;
+        }
+        return true;
+    }
+    
+    // 服务器模式下发给所有客户端，客户端模式下发给主机；帧只编码一次
+    bool sendFrame(const string& frame) {
+        if (!frameFits(frame)) return false;
+        vector<int> ids;
+        for (const auto& entry : clients) ids.push_back(entry.first);
+        bool allQueued = !ids.empty();
+        for (int id : ids) allQueued = sendFrameTo(id, frame) && allQueued;
+        return allQueued;
+    }
+    
+public:
+    NetworkManager() : sock(INVALID_SOCKET_HANDLE), isConnected(false), serverMode(false),
+                       listenPaused(false), nextClientId(1), listener(NULL) {
+#ifdef _WIN32
+        if (WSAStartup(MAKEWORD(2,2), &wsaData) != 0) {
+            cout << "WSAStartup failed!\n";
+        }
+#endif
+    }
+    
+    ~NetworkManager() {
+        disconnect();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+    
+    void setListener(NetworkListener* l) { listener = l; }
+    
+    bool startServer(int port) {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == INVALID_SOCKET_HANDLE) return false;
+        
+        int reuse = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        
+        sockaddr_in serverAddr;
+        memset(&serverAddr, 0, sizeof(serverAddr));
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_addr.s_addr = INADDR_ANY;
+        serverAddr.sin_port = htons(port);
+        
+        if (bind(sock, (sockaddr*)&serverAddr, sizeof(serverAddr)) != 0 ||
+            listen(sock, SOMAXCONN) != 0 ||
+            !setSocketNonBlocking(sock) ||
+            !poller.add(sock, LISTEN_TOKEN, false)) {
+            closeSocket(sock);
+            sock = INVALID_SOCKET_HANDLE;
+            return false;
+        }
+        
+        cout << "服务器已启动，监听端口 " << port << "...\n";
+        isConnected = true;
+        serverMode = true;
+        return true;
+    }
+    
+    // 客户端模式：再建立一条到主机的连接，返回连接 id，失败返回 -1
+    // 负载测试用一个管理器模拟多个客户端，各连接用 sendTo 分别发送
+    int openConnection(const string& ip, int port) {
+        if (serverMode) return -1;
+        SocketHandle s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s == INVALID_SOCKET_HANDLE) return -1;
+        
+        sockaddr_in serverAddr;
+        memset(&serverAddr, 0, sizeof(serverAddr));
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        inet_pton(AF_INET, ip.c_str(), &serverAddr.sin_addr);
+        
+        if (connect(s, (sockaddr*)&serverAddr, sizeof(serverAddr)) != 0) {
+            closeSocket(s);
+            return -1;
+        }
+        // 连上以后和服务器端一样走非阻塞的收发
+        ClientConnection& conn = addConnection(s, ip + ":" + to_string(port));
+        isConnected = true;
+        return conn.id;
+    }
+    
+    bool connectToServer(const string& ip, int port) {
+        if (openConnection(ip, port) < 0) return false;
+        cout << "已连接到服务器 " << ip << ":" << port << "\n";
+        return true;
+    }
+    
+    void disconnect() {
+        if (!isConnected) return;
+        for (auto& entry : clients) {
+            poller.remove(entry.second.sock);
+            closeSocket(entry.second.sock);
+        }
+        clients.clear();
+        closingClients.clear();
+        if (serverMode) {
+            poller.remove(sock);
+            closeSocket(sock);
+            sock = INVALID_SOCKET_HANDLE;
+        }
+        isConnected = false;
+        serverMode = false;
+        listenPaused = false;
+    }
+    
+    // 处理就绪的连接(接受、读、写、断开)，timeoutMs 为最长等待时间
+    // 收到的消息和连接变化在这里回调给 listener，返回处理的就绪事件数
+    int service(int timeoutMs) {
+        if (!isConnected) return 0;
+        reapClosed();
+        int ready = poller.wait(readyEvents, timeoutMs);
+        for (const PollerEvent& ev : readyEvents) {
+            if (serverMode && ev.token == LISTEN_TOKEN) {
+                acceptClients();
+                continue;
+            }
+            auto it = clients.find((int)ev.token);
+            if (it == clients.end() || it->second.closing) continue;
+            ClientConnection& conn = it->second;
+            
+            bool alive = true;
+            if (ev.readable || ev.hangup) alive = readFrom(conn);
+            if (alive && ev.writable) alive = flushOutput(conn);
+            if (!alive) dropClient(conn.id);
+        }
+        reapClosed();
+        // 客户端模式下连到主机的连接断了，整个会话结束
+        if (!serverMode && clients.empty()) isConnected = false;
+        return ready;
+    }
+    
+    template <typename T>
+    bool send(const T& msg) {
+        if (!isConnected) return false;
+        ScopedTimer timer(PROBE_NET_SEND);
+        WireWriter out(T::TYPE);
+        msg.write(out);
+        return sendFrame(out.finish());
+    }
+    
+    // 服务器模式：发给单个客户端，只进发送缓冲区，不阻塞
+    template <typename T>
+    bool sendTo(int clientId, const T& msg) {
+        ScopedTimer timer(PROBE_NET_SEND);
+        WireWriter out(T::TYPE);
+        msg.write(out);
+        return sendFrameTo(clientId, out.finish());
+    }
+    
+    // 标记断开，连接在本轮 service 结束时回收并通知 listener
+    void dropClient(int clientId) {
+        auto it = clients.find(clientId);
+        if (it == clients.end() || it->second.closing) return;
+        it->second.closing = true;
+        closingClients.push_back(clientId);
+    }
+    
+    int clientCount() const { return (int)clients.size(); }
+    
+    string clientAddress(int clientId) const {
+        auto it = clients.find(clientId);
+        return it == clients.end() ? string() : it->second.address;
+    }
+    
+    // 可和标准输入一起等待的句柄，没有时返回 -1
+    int waitHandle() const { return isConnected ? poller.waitHandle() : -1; }
+    
+    bool isServerMode() const { return serverMode; }
+    
+    bool isReady() const { return isConnected; }
+};
+
+// 倒计时显示的刷新间隔(毫秒)
+const int COUNTDOWN_TICK_MS = 100;
+
+// 联机对局：发出设置到第一个刺激出现的间隔(毫秒)
+const int NETWORK_START_DELAY_MS = 1500;
+
+// 单个试次的响应
+struct TrialResponse {
+    bool visual;
+    bool auditory;
+    long visualResponseTime;   // 刺激出现到第一次按 V 的毫秒数，没按为 -1
+    long auditoryResponseTime; // 刺激出现到第一次按 A 的毫秒数，没按为 -1
+    
+    TrialResponse() : visual(false), auditory(false), visualResponseTime(-1), auditoryResponseTime(-1) {}
+};
+
+// 单个试次的完整结果
+struct TrialOutcome {
+    Stimulus stimulus;
+    bool visualMatch;
+    bool auditoryMatch;
+    TrialResponse response;
+};
+
+// 线路消息：每种消息一个结构，write/read 按固定顺序编解码字段
+struct JoinMessage {
+    static const MessageType TYPE = MSG_JOIN;
+    string playerName;
+    
+    void write(WireWriter& out) const { out.str(playerName); }
+    bool read(WireReader& in) { playerName = in.str(); return in.ok(); }
+};
+
+struct SettingsMessage {
+    static const MessageType TYPE = MSG_SETTINGS;
+    int n;
+    int totalTrials;
+    int stimulusDuration;
+    int interStimulusInterval;
+    uint64_t seed;
+    
+    void write(WireWriter& out) const {
+        out.u16((uint16_t)n);
+        out.u16((uint16_t)totalTrials);
+        out.u32((uint32_t)stimulusDuration);
+        out.u32((uint32_t)interStimulusInterval);
+        out.u64(seed);
+    }
+    
+    bool read(WireReader& in) {
+        n = in.u16();
+        totalTrials = in.u16();
+        stimulusDuration = (int)in.u32();
+        interStimulusInterval = (int)in.u32();
+        seed = in.u64();
+        return in.ok();
+    }
+};
+
+struct StimulusMessage {
+    static const MessageType TYPE = MSG_STIMULUS;
+    int trialIndex;
+    Stimulus stimulus;
+    int durationMs;  // 本试次接受按键的时长
+    
+    void write(WireWriter& out) const {
+        out.u16((uint16_t)trialIndex);
+        out.u8((uint8_t)stimulus.visualPosition);
+        out.u8((uint8_t)stimulus.auditoryLetter);
+        out.u32((uint32_t)durationMs);
+    }
+    
+    bool read(WireReader& in) {
+        trialIndex = in.u16();
+        stimulus.visualPosition = in.u8();
+        stimulus.auditoryLetter = (char)in.u8();
+        durationMs = (int)in.u32();
+        return in.ok();
+    }
+};
+
+struct ResponseMessage {
+    static const MessageType TYPE = MSG_RESPONSE;
+    int trialIndex;
+    TrialResponse response;
+    
+    void write(WireWriter& out) const {
+        out.u16((uint16_t)trialIndex);
+        out.u8((response.visual ? 1 : 0) | (response.auditory ? 2 : 0));
+        out.i32((int32_t)response.visualResponseTime);
+        out.i32((int32_t)response.auditoryResponseTime);
+    }
+    
+    bool read(WireReader& in) {
+        trialIndex = in.u16();
+        uint8_t keys = in.u8();
+        response.visual = (keys & 1) != 0;
+        response.auditory = (keys & 2) != 0;
+        response.visualResponseTime = in.i32();
+        response.auditoryResponseTime = in.i32();
+        return in.ok();
+    }
+};
+
+// 成绩字段的编码(计数 + 十分之一毫秒精度的反应时间)，SCORE 和 LEADERBOARD 共用
+inline void writeGameStats(WireWriter& out, const GameStats& stats) {
+    out.str(stats.playerName);
+    out.u16((uint16_t)stats.nValue);
+    out.u16((uint16_t)stats.totalTrials);
+    out.u16((uint16_t)stats.visualHits);
+    out.u16((uint16_t)stats.visualFalseAlarms);
+    out.u16((uint16_t)stats.visualMisses);
+    out.u16((uint16_t)stats.visualCorrectRejections);
+    out.u16((uint16_t)stats.auditoryHits);
+    out.u16((uint16_t)stats.auditoryFalseAlarms);
+    out.u16((uint16_t)stats.auditoryMisses);
+    out.u16((uint16_t)stats.auditoryCorrectRejections);
+    out.u16((uint16_t)stats.visualResponseCount);
+    out.u16((uint16_t)stats.auditoryResponseCount);
+    out.u32((uint32_t)(stats.responseTimeAvg * 10 + 0.5));
+    out.u32((uint32_t)(stats.visualResponseTimeAvg * 10 + 0.5));
+    out.u32((uint32_t)(stats.auditoryResponseTimeAvg * 10 + 0.5));
+}
+
+inline bool readGameStats(WireReader& in, GameStats& stats) {
+    stats.playerName = in.str();
+    stats.nValue = in.u16();
+    stats.totalTrials = in.u16();
+    stats.visualHits = in.u16();
+    stats.visualFalseAlarms = in.u16();
+    stats.visualMisses = in.u16();
+    stats.visualCorrectRejections = in.u16();
+    stats.auditoryHits = in.u16();
+    stats.auditoryFalseAlarms = in.u16();
+    stats.auditoryMisses = in.u16();
+    stats.auditoryCorrectRejections = in.u16();
+    stats.visualResponseCount = in.u16();
+    stats.auditoryResponseCount = in.u16();
+    stats.responseTimeAvg = in.u32() / 10.0;
+    stats.visualResponseTimeAvg = in.u32() / 10.0;
+    stats.auditoryResponseTimeAvg = in.u32() / 10.0;
+    stats.calculateAccuracies();
+    return in.ok();
+}
+
+struct ScoreMessage {
+    static const MessageType TYPE = MSG_SCORE;
+    int trialIndex;
+    bool visualMatch;
+    bool auditoryMatch;
+    TrialResponse response;  // 主机采纳的响应
+    GameStats stats;         // 该玩家截至本试次的累计成绩
+    
+    void write(WireWriter& out) const {
+        out.u16((uint16_t)trialIndex);
+        out.u8((visualMatch ? 1 : 0) | (auditoryMatch ? 2 : 0) |
+               (response.visual ? 4 : 0) | (response.auditory ? 8 : 0));
+        writeGameStats(out, stats);
+    }
+    
+    bool read(WireReader& in) {
+        trialIndex = in.u16();
+        uint8_t flags = in.u8();
+        visualMatch = (flags & 1) != 0;
+        auditoryMatch = (flags & 2) != 0;
+        response.visual = (flags & 4) != 0;
+        response.auditory = (flags & 8) != 0;
+        return readGameStats(in, stats);
+    }
+};
+
+// 排行榜消息只带前 LEADERBOARD_WIRE_TOP 名，名次在这之后的客户端再附上自己那一行，
+// 帧大小与房间人数无关。每行最多 1+255 字节名字加 36 字节计数
+const size_t LEADERBOARD_WIRE_TOP = 100;
+const size_t LEADERBOARD_WIRE_ENTRIES = LEADERBOARD_WIRE_TOP + 1;
+static_assert(2 + 4 + 4 + LEADERBOARD_WIRE_ENTRIES * (1 + 255 + 36) <= WIRE_MAX_PAYLOAD,
+              "leaderboard frame must fit in WIRE_MAX_PAYLOAD");
+
+struct LeaderboardMessage {
+    static const MessageType TYPE = MSG_LEADERBOARD;
+    vector<GameStats> entries;   // 按名次排好的前几名，ownRank 非 0 时最后一行是收件人自己
+    uint32_t playerCount;        // 本局总人数
+    uint32_t ownRank;            // 收件人名次不在前几名时为其名次(从 1 起)，否则为 0
+    
+    LeaderboardMessage() : playerCount(0), ownRank(0) {}
+    
+    void write(WireWriter& out) const {
+        size_t count = min(entries.size(), LEADERBOARD_WIRE_ENTRIES);
+        out.u16((uint16_t)count);
+        out.u32(playerCount);
+        out.u32(ownRank);
+        for (size_t i = 0; i < count; i++) writeGameStats(out, entries[i]);
+    }
+    
+    bool read(WireReader& in) {
+        size_t count = in.u16();
+        playerCount = in.u32();
+        ownRank = in.u32();
+        if (count > LEADERBOARD_WIRE_ENTRIES) return false;
+        entries.clear();
+        for (size_t i = 0; i < count && in.ok(); i++) {
+            GameStats stats;
+            if (readGameStats(in, stats)) entries.push_back(stats);
+        }
+        return in.ok();
+    }
+};
+
+// 响应来源：键盘玩家、模拟玩家等都实现这个接口
+class ResponseSource {
+public:
+    virtual ~ResponseSource() {}
+    
+    // 给出本试次的响应；匹配情况只供模拟玩家使用，真实玩家应忽略
+    virtual TrialResponse respond(const Stimulus& stim, int trialIndex,
+                                  bool visualMatch, bool auditoryMatch) = 0;
+};
+
+// 虚拟时钟：无头模式下按试次推进时间，不真正等待
+class VirtualClock {
+private:
+    long long nowMs;
+    
+public:
+    VirtualClock() : nowMs(0) {}
+    
+    long long now() const { return nowMs; }
+    void advance(long long ms) { nowMs += ms; }
+};
+
+// 模拟玩家：按设定的命中率和虚报率作答，反应时间在均值附近随机波动
+class SimulatedPlayer : public ResponseSource {
+private:
+    double hitRate;
+    double falseAlarmRate;
+    long meanResponseTime;
+    long responseTimeJitter;
+    long windowMs;
+    Xoshiro256 rng;
+    
+    bool decide(bool isMatch) {
+        return rng.chance(isMatch ? hitRate : falseAlarmRate);
+    }
+    
+    long drawResponseTime() {
+        long rt = meanResponseTime + (long)((rng.uniform() * 2.0 - 1.0) * responseTimeJitter);
+        return max(100L, min(rt, windowMs - 1));
+    }
+    
+public:
+    SimulatedPlayer(double hit, double falseAlarm, long meanRt = 800, long rtJitter = 300,
+                    long stimulusWindowMs = 2000, uint64_t seed = 1)
+        : hitRate(hit), falseAlarmRate(falseAlarm), meanResponseTime(meanRt),
+          responseTimeJitter(rtJitter), windowMs(stimulusWindowMs), rng(seed) {}
+    
+    TrialResponse respond(const Stimulus&, int, bool visualMatch, bool auditoryMatch) override {
+        TrialResponse response;
+        response.visual = decide(visualMatch);
+        response.auditory = decide(auditoryMatch);
+        
+        if (response.visual) response.visualResponseTime = drawResponseTime();
+        if (response.auditory) response.auditoryResponseTime = drawResponseTime();
+        return response;
+    }
+};
+
+// 试次调度器：每个试次的刺激出现/消失时刻都由会话开始时刻按绝对时间推算
+// (单调时钟上的 sleep_until)，渲染等开销不会逐次累积成漂移。
+// 试次 i 在 start + i*(刺激时长+间隔) 出现，刺激时长后消失，间隔期间显示反馈
+class TrialScheduler {
+private:
+    chrono::steady_clock::time_point sessionStart;
+    chrono::milliseconds stimulusDuration;
+    chrono::milliseconds interStimulusInterval;
+    vector<long long> onsetErrorsUs;
+    
+public:
+    TrialScheduler(int stimDurationMs = 2000, int isiMs = 500)
+        : sessionStart(chrono::steady_clock::now()), stimulusDuration(stimDurationMs),
+          interStimulusInterval(isiMs) {}
+    
+    void configure(int stimDurationMs, int isiMs) {
+        stimulusDuration = chrono::milliseconds(stimDurationMs);
+        interStimulusInterval = chrono::milliseconds(isiMs);
+    }
+    
+    // 以 start 作为第一个试次的出现时刻开始新会话
+    void start(chrono::steady_clock::time_point startTime = chrono::steady_clock::now()) {
+        sessionStart = startTime;
+        onsetErrorsUs.clear();
+    }
+    
+    chrono::steady_clock::time_point plannedOnset(int trialIndex) const {
+        return sessionStart + trialIndex * (stimulusDuration + interStimulusInterval);
+    }
+    
+    chrono::steady_clock::time_point plannedOffset(int trialIndex) const {
+        return plannedOnset(trialIndex) + stimulusDuration;
+    }
+    
+    void waitUntil(chrono::steady_clock::time_point deadline) const {
+        this_thread::sleep_until(deadline);
+    }
+    
+    // 记录试次的实际出现时刻，保存与计划时刻的偏差(微秒，正数表示晚了)
+    void recordOnset(int trialIndex, chrono::steady_clock::time_point actual) {
+        auto error = actual - plannedOnset(trialIndex);
+        if ((int)onsetErrorsUs.size() <= trialIndex) {
+            onsetErrorsUs.resize(trialIndex + 1, 0);
+        }
+        onsetErrorsUs[trialIndex] = chrono::duration_cast<chrono::microseconds>(error).count();
+        TimingProbes::instance().record(PROBE_ONSET_LATENESS, error);
+    }
+    
+    const vector<long long>& onsetErrors() const { return onsetErrorsUs; }
+};
+
+// 逐试次事件日志 nback_trials.log：只追加的列式二进制格式(全部小端序)
+//
+//   文件头 8 字节   "NBTL"、u32 版本
+//   数据块          每局每个玩家一块，试次过多时拆成多块
+//     块头 48 字节  "NBTB"、u32 块长度(含块头)、u32 CRC(块长度之后的全部字节)、u16 块头长度、u16 行数、
+//                   u64 会话 id、u64 种子、i64 开始时间(Unix 毫秒)、u32 首个试次序号、u16 N、u16 名字长度
+//     玩家名字      紧跟块头，补零到 8 字节对齐
+//     列            每列定长、连续存放同一字段的全部行：
+//                   i32 视觉反应时、i32 听觉反应时(毫秒，没按为 -1)、i32 出现偏差(微秒)、
+//                   u8 位置、u8 字母、u8 标记(位 0/1 视觉/听觉匹配，位 2/3 视觉/听觉有响应)
+// 同一场多人比赛的各块共用一个会话 id。写到一半的尾块校验不过，读取时忽略
+const char* const TRIAL_LOG_FILE = "nback_trials.log";
+const char TRIAL_LOG_MAGIC[4] = {'N', 'B', 'T', 'L'};
+const uint32_t TRIAL_LOG_VERSION = 1;
+const size_t TRIAL_LOG_HEADER_SIZE = 8;
+const char TRIAL_BLOCK_MAGIC[4] = {'N', 'B', 'T', 'B'};
+const size_t TRIAL_BLOCK_HEADER_SIZE = 48;
+const size_t TRIAL_BLOCK_MAX_ROWS = 1024;
+const size_t TRIAL_BLOCK_MAX_SIZE = ((TRIAL_BLOCK_HEADER_SIZE + 0xFFFF + 7) & ~(size_t)7) + TRIAL_BLOCK_MAX_ROWS * (3 * 4 + 3);
+
+enum TrialEventFlag {
+    TRIAL_VISUAL_MATCH = 1,
+    TRIAL_AUDITORY_MATCH = 2,
+    TRIAL_VISUAL_RESPONSE = 4,
+    TRIAL_AUDITORY_RESPONSE = 8
+};
+
+// 一个数据块：块头字段加上按列存放的各试次数据
+struct TrialEventBlock {
+    uint64_t sessionId;
+    uint64_t seed;
+    int64_t startTimeMs;
+    uint32_t firstTrial;
+    int n;
+    string playerName;
+    
+    vector<int32_t> visualRt;
+    vector<int32_t> auditoryRt;
+    vector<int32_t> onsetErrorUs;
+    vector<uint8_t> position;
+    vector<uint8_t> letter;
+    vector<uint8_t> flags;
+    
+    TrialEventBlock() : sessionId(0), seed(0), startTimeMs(0), firstTrial(0), n(0) {}
+    
+    TrialEventBlock(uint64_t session, const string& player, int nValue, uint64_t sessionSeed)
+        : sessionId(session), seed(sessionSeed),
+          startTimeMs(chrono::duration_cast<chrono::milliseconds>(
+              chrono::system_clock::now().time_since_epoch()).count()),
+          firstTrial(0), n(nValue), playerName(player) {}
+    
+    size_t rows() const { return flags.size(); }
+    
+    // 块头字段相同、没有任何行的块
+    TrialEventBlock emptyCopy() const {
+        TrialEventBlock copy;
+        copy.sessionId = sessionId;
+        copy.seed = seed;
+        copy.startTimeMs = startTimeMs;
+        copy.firstTrial = firstTrial;
+        copy.n = n;
+        copy.playerName = playerName;
+        return copy;
+    }
+    
+    void reserve(size_t count) {
+        visualRt.reserve(count);
+        auditoryRt.reserve(count);
+        onsetErrorUs.reserve(count);
+        position.reserve(count);
+        letter.reserve(count);
+        flags.reserve(count);
+    }
+    
+    void append(const TrialOutcome& outcome, long long onsetError) {
+        const TrialResponse& r = outcome.response;
+        visualRt.push_back(r.visual ? (int32_t)r.visualResponseTime : -1);
+        auditoryRt.push_back(r.auditory ? (int32_t)r.auditoryResponseTime : -1);
+        onsetErrorUs.push_back((int32_t)max<long long>(INT32_MIN, min<long long>(onsetError, INT32_MAX)));
+        position.push_back((uint8_t)outcome.stimulus.visualPosition);
+        letter.push_back((uint8_t)outcome.stimulus.auditoryLetter);
+        flags.push_back((outcome.visualMatch ? TRIAL_VISUAL_MATCH : 0) |
+                        (outcome.auditoryMatch ? TRIAL_AUDITORY_MATCH : 0) |
+                        (r.visual ? TRIAL_VISUAL_RESPONSE : 0) |
+                        (r.auditory ? TRIAL_AUDITORY_RESPONSE : 0));
+    }
+    
+    static size_t headerLength(size_t nameLength) {
+        return (TRIAL_BLOCK_HEADER_SIZE + nameLength + 7) & ~(size_t)7;
+    }
+    
+    // 编码 [begin, end) 行为一个数据块
+    void encodeRange(string& out, size_t begin, size_t end) const {
+        size_t nameLength = min<size_t>(playerName.size(), 0xFFFF);
+        size_t count = end - begin;
+        size_t headerBytes = headerLength(nameLength);
+        size_t total = headerBytes + count * (3 * 4 + 3);
+        size_t base = out.size();
+        out.resize(base + total, '\0');
+        unsigned char* b = (unsigned char*)&out[base];
+        
+        memcpy(b, TRIAL_BLOCK_MAGIC, 4);
+        putLE32(b + 4, (uint32_t)total);
+        putLE16(b + 12, (uint16_t)headerBytes);
+        putLE16(b + 14, (uint16_t)count);
+        putLE64(b + 16, sessionId);
+        putLE64(b + 24, seed);
+        putLE64(b + 32, (uint64_t)startTimeMs);
+        putLE32(b + 40, firstTrial + (uint32_t)begin);
+        putLE16(b + 44, (uint16_t)n);
+        putLE16(b + 46, (uint16_t)nameLength);
+        memcpy(b + TRIAL_BLOCK_HEADER_SIZE, playerName.data(), nameLength);
+        
+        unsigned char* p = b + headerBytes;
+        for (size_t i = begin; i < end; i++, p += 4) putLE32(p, (uint32_t)visualRt[i]);
+        for (size_t i = begin; i < end; i++, p += 4) putLE32(p, (uint32_t)auditoryRt[i]);
+        for (size_t i = begin; i < end; i++, p += 4) putLE32(p, (uint32_t)onsetErrorUs[i]);
+        memcpy(p, position.data() + begin, count);
+        memcpy(p + count, letter.data() + begin, count);
+        memcpy(p + 2 * count, flags.data() + begin, count);
+        
+        putLE32(b + 8, crc32(b + 12, total - 12));
+    }
+    
+    // 编码全部行，超过 TRIAL_BLOCK_MAX_ROWS 时拆成多个块
+    void encode(string& out) const {
+        for (size_t begin = 0; begin < rows(); begin += TRIAL_BLOCK_MAX_ROWS) {
+            encodeRange(out, begin, min(rows(), begin + TRIAL_BLOCK_MAX_ROWS));
+        }
+    }
+    
+    // 解析一个数据块，返回占用的字节数；数据不完整或校验不过返回 0
+    size_t decode(const unsigned char* b, size_t available) {
+        if (available < TRIAL_BLOCK_HEADER_SIZE || memcmp(b, TRIAL_BLOCK_MAGIC, 4) != 0) return 0;
+        size_t total = getLE32(b + 4);
+        size_t headerBytes = getLE16(b + 12);
+        size_t count = getLE16(b + 14);
+        size_t nameLength = getLE16(b + 46);
+        if (total > available || headerBytes != headerLength(nameLength) ||
+            total != headerBytes + count * (3 * 4 + 3) || getLE32(b + 8) != crc32(b + 12, total - 12)) {
+            return 0;
+        }
+        
+        sessionId = getLE64(b + 16);
+        seed = getLE64(b + 24);
+        startTimeMs = (int64_t)getLE64(b + 32);
+        firstTrial = getLE32(b + 40);
+        n = getLE16(b + 44);
+        playerName.assign((const char*)b + TRIAL_BLOCK_HEADER_SIZE, nameLength);
+        
+        const unsigned char* p = b + headerBytes;
+        visualRt.resize(count);
+        auditoryRt.resize(count);
+        onsetErrorUs.resize(count);
+        for (size_t i = 0; i < count; i++, p += 4) visualRt[i] = (int32_t)getLE32(p);
+        for (size_t i = 0; i < count; i++, p += 4) auditoryRt[i] = (int32_t)getLE32(p);
+        for (size_t i = 0; i < count; i++, p += 4) onsetErrorUs[i] = (int32_t)getLE32(p);
+        position.assign(p, p + count);
+        letter.assign(p + count, p + 2 * count);
+        flags.assign(p + 2 * count, p + 3 * count);
+        return total;
+    }
+};
+
+// 读出日志里全部完整的数据块，文件不存在或文件头不对返回 false
+bool readTrialEventLog(const string& path, vector<TrialEventBlock>& blocks) {
+    string data;
+    if (!readWholeFile(path, data)) return false;
+    const unsigned char* p = (const unsigned char*)data.data();
+    if (data.size() < TRIAL_LOG_HEADER_SIZE || memcmp(p, TRIAL_LOG_MAGIC, 4) != 0 ||
+        getLE32(p + 4) != TRIAL_LOG_VERSION) {
+        return false;
+    }
+    size_t offset = TRIAL_LOG_HEADER_SIZE;
+    while (offset < data.size()) {
+        TrialEventBlock block;
+        size_t used = block.decode(p + offset, data.size() - offset);
+        if (used == 0) break;
+        blocks.push_back(move(block));
+        offset += used;
+    }
+    return true;
+}
+
+// 试次事件日志的后台写入：试次循环只往内存里的块追加一行，
+// 本局结束时交给写线程编码并追加到文件，不在试次循环里做任何磁盘 I/O
+class TrialEventLog {
+private:
+    mutex queueMutex;
+    condition_variable wake;
+    condition_variable drained;
+    deque<TrialEventBlock> queue;
+    uint64_t submittedBlocks;
+    uint64_t finishedBlocks;
+    bool stopping;
+    bool disabled;        // 同名文件不是本格式，不去覆盖它
+    bool fileChecked;
+    thread writer;
+    
+    TrialEventLog() : submittedBlocks(0), finishedBlocks(0), stopping(false),
+                      disabled(false), fileChecked(false) {}
+    
+    ~TrialEventLog() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (writer.joinable()) writer.join();
+    }
+    
+    // 首次写入前检查文件：不存在或为空时先写文件头，已有文件必须是本格式；
+    // 上次写到一半的尾块截掉，否则之后追加的块都读不到。
+    // 正常关闭的文件只校验最后一个块，找不到完整的尾块(崩溃过)才从头扫描
+    bool prepareFile(string& batch) {
+        MappedFile file;
+        if (!file.open(TRIAL_LOG_FILE)) {
+            string existing;
+            if (readWholeFile(TRIAL_LOG_FILE, existing) && !existing.empty()) return false;
+            string header(TRIAL_LOG_HEADER_SIZE, '\0');
+            memcpy(&header[0], TRIAL_LOG_MAGIC, 4);
+            putLE32((unsigned char*)&header[4], TRIAL_LOG_VERSION);
+            batch.insert(0, header);
+            return true;
+        }
+        const unsigned char* p = file.data();
+        size_t size = file.size();
+        if (size < TRIAL_LOG_HEADER_SIZE || memcmp(p, TRIAL_LOG_MAGIC, 4) != 0 ||
+            getLE32(p + 4) != TRIAL_LOG_VERSION) {
+            return false;
+        }
+        if (size == TRIAL_LOG_HEADER_SIZE) return true;
+        
+        // 从文件末尾往前找恰好结束在文件末尾、校验通过的块
+        TrialEventBlock scratch;
+        size_t lowest = size - min(size - TRIAL_LOG_HEADER_SIZE, TRIAL_BLOCK_MAX_SIZE);
+        for (size_t start = size; start-- > lowest;) {
+            if (size - start >= TRIAL_BLOCK_HEADER_SIZE && getLE32(p + start + 4) == size - start &&
+                scratch.decode(p + start, size - start) == size - start) {
+                return true;
+            }
+        }
+        
+        size_t offset = TRIAL_LOG_HEADER_SIZE;
+        while (offset < size) {
+            size_t used = scratch.decode(p + offset, size - offset);
+            if (used == 0) break;
+            offset += used;
+        }
+        string data((const char*)p, offset);
+        file.close();
+        return replaceFileDurable(TRIAL_LOG_FILE, data);
+    }
+    
+    void writerLoop() {
+        unique_lock<mutex> lock(queueMutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) break;
+            
+            deque<TrialEventBlock> batchBlocks;
+            batchBlocks.swap(queue);
+            lock.unlock();
+            
+            string batch;
+            for (const TrialEventBlock& block : batchBlocks) block.encode(batch);
+            bool ok = true;
+            if (!fileChecked) {
+                disabled = !prepareFile(batch);
+                fileChecked = true;
+            }
+            if (!disabled) ok = writeFileDurable(TRIAL_LOG_FILE, batch, true);
+            
+            lock.lock();
+            if (!ok) {
+                // 写失败(如磁盘满)时放回队列稍后重试；退出时放弃
+                if (stopping) break;
+                fileChecked = false;
+                for (auto it = batchBlocks.rbegin(); it != batchBlocks.rend(); ++it) {
+                    queue.push_front(move(*it));
+                }
+                wake.wait_for(lock, chrono::seconds(1));
+                continue;
+            }
+            finishedBlocks += batchBlocks.size();
+            drained.notify_all();
+        }
+        finishedBlocks = submittedBlocks;
+        drained.notify_all();
+    }
+    
+public:
+    static TrialEventLog& instance() {
+        static TrialEventLog log;
+        return log;
+    }
+    
+    TrialEventLog(const TrialEventLog&) = delete;
+    TrialEventLog& operator=(const TrialEventLog&) = delete;
+    
+    // 记录一个试次：只在内存里追加一行，整局结束后再交给写线程
+    void record(TrialEventBlock& block, int trialIndex, const TrialOutcome& outcome,
+                long long onsetErrorUs = 0) {
+        if (block.rows() == 0) block.firstTrial = (uint32_t)trialIndex;
+        block.append(outcome, onsetErrorUs);
+    }
+    
+    // 把块交给写线程，块保留块头字段、清空所有行以便继续记录
+    void submit(TrialEventBlock& block) {
+        if (block.rows() == 0) return;
+        TrialEventBlock sealed = move(block);
+        block = sealed.emptyCopy();
+        {
+            lock_guard<mutex> lock(queueMutex);
+            if (!writer.joinable()) writer = thread(&TrialEventLog::writerLoop, this);
+            queue.push_back(move(sealed));
+            submittedBlocks++;
+        }
+        wake.notify_one();
+    }
+    
+    // 等待已交出的块全部写完
+    void flush() {
+        unique_lock<mutex> lock(queueMutex);
+        uint64_t target = submittedBlocks;
+        drained.wait(lock, [this, target] { return finishedBlocks >= target; });
+    }
+};
+
+// 信号检测分析：命中率、虚报率、d′、判断标准 c、A′，逐间隔的按键率(诱饵干扰)和反应时间分布。
+// 输入是试次事件日志的列，一局和整个历史走同一套计算
+const int ANALYSIS_MAX_LAG = 8;    // 逐间隔统计到 8 步前
+const int RT_BIN_MS = 10;          // 反应时间分布的桶宽
+const int RT_BIN_COUNT = 500;      // 最后一个桶收 5 秒及以上
+
+inline int popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// 标准正态分布的分位数(Acklam 有理逼近，相对误差约 1e-9)
+inline double normalQuantile(double p) {
+    static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                               1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                               6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                               -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                               3.754408661907416e+00};
+    const double low = 0.02425;
+    if (p <= 0) return -HUGE_VAL;
+    if (p >= 1) return HUGE_VAL;
+    if (p < low || p > 1 - low) {
+        double q = sqrt(-2 * log(p < low ? p : 1 - p));
+        double x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+                   ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+        return p < low ? x : -x;
+    }
+    double q = p - 0.5;
+    double r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+// 一个模态的四类计数及由此得出的信号检测指标。
+// d′ 和 c 用对数线性校正后的比率 (x+0.5)/(n+1)，全对或全错时也是有限值
+struct SignalDetection {
+    long long hits;
+    long long misses;
+    long long falseAlarms;
+    long long correctRejections;
+    
+    SignalDetection() : hits(0), misses(0), falseAlarms(0), correctRejections(0) {}
+    
+    SignalDetection(long long h, long long m, long long fa, long long cr)
+        : hits(h), misses(m), falseAlarms(fa), correctRejections(cr) {}
+    
+    static SignalDetection visualOf(const GameStats& s) {
+        return SignalDetection(s.visualHits, s.visualMisses, s.visualFalseAlarms, s.visualCorrectRejections);
+    }
+    
+    static SignalDetection auditoryOf(const GameStats& s) {
+        return SignalDetection(s.auditoryHits, s.auditoryMisses, s.auditoryFalseAlarms, s.auditoryCorrectRejections);
+    }
+    
+    SignalDetection& operator+=(const SignalDetection& other) {
+        hits += other.hits;
+        misses += other.misses;
+        falseAlarms += other.falseAlarms;
+        correctRejections += other.correctRejections;
+        return *this;
+    }
+    
+    long long signalTrials() const { return hits + misses; }
+    long long noiseTrials() const { return falseAlarms + correctRejections; }
+    
+    double hitRate() const { return signalTrials() > 0 ? (double)hits / signalTrials() : 0; }
+    double falseAlarmRate() const { return noiseTrials() > 0 ? (double)falseAlarms / noiseTrials() : 0; }
+    
+    double hitZ() const { return normalQuantile((hits + 0.5) / (signalTrials() + 1.0)); }
+    double falseAlarmZ() const { return normalQuantile((falseAlarms + 0.5) / (noiseTrials() + 1.0)); }
+    
+    double dPrime() const { return hitZ() - falseAlarmZ(); }
+    double criterion() const { return -0.5 * (hitZ() + falseAlarmZ()); }
+    
+    // 非参数辨别力 A′，0.5 为随机水平
+    double aPrime() const {
+        double h = hitRate();
+        double f = falseAlarmRate();
+        if (h == f) return 0.5;
+        if (h > f) return 0.5 + (h - f) * (1 + h - f) / (4 * h * (1 - f));
+        return 0.5 - (f - h) * (1 + f - h) / (4 * f * (1 - h));
+    }
+};
+
+// 反应时间分布：计数、均值、标准差、最值，分位数由 10 毫秒一桶的直方图估计
+struct ResponseTimeDistribution {
+    long long count;
+    double sum;
+    double sumSquares;
+    int minimum;
+    int maximum;
+    vector<uint32_t> bins;
+    
+    ResponseTimeDistribution() : count(0), sum(0), sumSquares(0), minimum(0), maximum(0), bins(RT_BIN_COUNT, 0) {}
+    
+    double mean() const { return count > 0 ? sum / count : 0; }
+    
+    double standardDeviation() const {
+        if (count < 2) return 0;
+        double m = mean();
+        return sqrt(max(0.0, (sumSquares - count * m * m) / (count - 1)));
+    }
+    
+    // 第 p 分位(0-1)，取所在桶的中点
+    double percentile(double p) const {
+        if (count == 0) return 0;
+        long long target = (long long)ceil(p * count);
+        long long seen = 0;
+        for (int i = 0; i < RT_BIN_COUNT; i++) {
+            seen += bins[i];
+            if (seen >= max(1LL, target)) return i * RT_BIN_MS + RT_BIN_MS / 2.0;
+        }
+        return maximum;
+    }
+};
+
+// 一个模态的分析结果
+struct ModalityAnalysis {
+    SignalDetection detection;
+    long long lagTrials[ANALYSIS_MAX_LAG + 1];     // 与 lag 步前刺激相同的试次数
+    long long lagResponses[ANALYSIS_MAX_LAG + 1];  // 其中按了键的试次数
+    ResponseTimeDistribution hitTimes;
+    ResponseTimeDistribution falseAlarmTimes;
+    
+    ModalityAnalysis() {
+        fill(lagTrials, lagTrials + ANALYSIS_MAX_LAG + 1, 0);
+        fill(lagResponses, lagResponses + ANALYSIS_MAX_LAG + 1, 0);
+    }
+    
+    double lagResponseRate(int lag) const {
+        return lagTrials[lag] > 0 ? (double)lagResponses[lag] / lagTrials[lag] : 0;
+    }
+};
+
+struct TrialAnalysis {
+    long long trials;
+    ModalityAnalysis visual;
+    ModalityAnalysis auditory;
+    
+    TrialAnalysis() : trials(0) {}
+};
+
+// 批量分析：每列标记先压成 64 位一字的位图，四类计数和逐间隔计数都是按字的与/非加 popcount；
+// 逐间隔比较和反应时间求和都是无分支的定长循环，编译器可以直接向量化。
+// 位图缓冲在多次调用之间复用，一局和上百万个试次的历史都只扫描一遍
+class TrialAnalyzer {
+private:
+    TrialAnalysis result;
+    vector<uint64_t> matchBits;
+    vector<uint64_t> responseBits;
+    vector<uint64_t> repeatBits;
+    vector<uint8_t> lane;
+    
+    // 第 i 位为 (flags[i] & mask) != 0
+    void packFlags(const uint8_t* flags, size_t count, uint8_t mask, vector<uint64_t>& out) {
+        lane.resize(count);
+        for (size_t i = 0; i < count; i++) lane[i] = (flags[i] & mask) != 0;
+        packLane(count, out);
+    }
+    
+    // 第 i 位为 values[i] == values[i - lag]，前 lag 行没有参照，记为 0
+    void packRepeats(const uint8_t* values, size_t count, size_t lag, vector<uint64_t>& out) {
+        lane.assign(count, 0);
+        for (size_t i = lag; i < count; i++) lane[i] = values[i] == values[i - lag];
+        packLane(count, out);
+    }
+    
+    void packLane(size_t count, vector<uint64_t>& out) {
+        out.assign((count + 63) / 64, 0);
+        for (size_t w = 0; w < out.size(); w++) {
+            size_t base = w * 64;
+            size_t width = min<size_t>(64, count - base);
+            uint64_t word = 0;
+            for (size_t j = 0; j < width; j++) word |= (uint64_t)lane[base + j] << j;
+            out[w] = word;
+        }
+    }
+    
+    static void addTimes(ResponseTimeDistribution& dist, const int32_t* rt, const uint8_t* flags,
+                         size_t count, uint8_t mask, uint8_t want) {
+        // 求和、平方和与计数：无分支的掩码累加
+        long long n = 0;
+        double sum = 0;
+        double sumSquares = 0;
+        for (size_t i = 0; i < count; i++) {
+            bool take = (flags[i] & mask) == want && rt[i] >= 0;
+            double v = take ? rt[i] : 0;
+            n += take;
+            sum += v;
+            sumSquares += v * v;
+        }
+        if (n == 0) return;
+        for (size_t i = 0; i < count; i++) {
+            if ((flags[i] & mask) != want || rt[i] < 0) continue;
+            int v = rt[i];
+            dist.bins[min(v / RT_BIN_MS, RT_BIN_COUNT - 1)]++;
+            if (dist.count == 0 || v < dist.minimum) dist.minimum = v;
+            if (dist.count == 0 || v > dist.maximum) dist.maximum = v;
+            dist.count++;
+        }
+        dist.sum += sum;
+        dist.sumSquares += sumSquares;
+    }
+    
+    void analyzeModality(ModalityAnalysis& m, const uint8_t* flags, const uint8_t* values, const int32_t* rt,
+                         size_t count, uint8_t matchFlag, uint8_t responseFlag) {
+        packFlags(flags, count, matchFlag, matchBits);
+        packFlags(flags, count, responseFlag, responseBits);
+        
+        long long hits = 0, misses = 0, falseAlarms = 0;
+        size_t words = matchBits.size();
+        for (size_t w = 0; w < words; w++) {
+            uint64_t valid = (w + 1 < words || count % 64 == 0) ? ~0ULL : (1ULL << (count % 64)) - 1;
+            hits += popcount64(matchBits[w] & responseBits[w]);
+            misses += popcount64(matchBits[w] & ~responseBits[w]);
+            falseAlarms += popcount64(~matchBits[w] & responseBits[w] & valid);
+        }
+        m.detection += SignalDetection(hits, misses, falseAlarms, (long long)count - hits - misses - falseAlarms);
+        
+        for (int lag = 1; lag <= ANALYSIS_MAX_LAG; lag++) {
+            if ((size_t)lag >= count) break;
+            packRepeats(values, count, lag, repeatBits);
+            long long trials = 0, responses = 0;
+            for (size_t w = 0; w < words; w++) {
+                trials += popcount64(repeatBits[w]);
+                responses += popcount64(repeatBits[w] & responseBits[w]);
+            }
+            m.lagTrials[lag] += trials;
+            m.lagResponses[lag] += responses;
+        }
+        
+        addTimes(m.hitTimes, rt, flags, count, matchFlag | responseFlag, matchFlag | responseFlag);
+        addTimes(m.falseAlarmTimes, rt, flags, count, matchFlag | responseFlag, responseFlag);
+    }
+    
+public:
+    // 分析一块试次；逐间隔比较不跨块
+    void add(const TrialEventBlock& block) {
+        size_t count = block.rows();
+        if (count == 0) return;
+        analyzeModality(result.visual, block.flags.data(), block.position.data(), block.visualRt.data(),
+                        count, TRIAL_VISUAL_MATCH, TRIAL_VISUAL_RESPONSE);
+        analyzeModality(result.auditory, block.flags.data(), block.letter.data(), block.auditoryRt.data(),
+                        count, TRIAL_AUDITORY_MATCH, TRIAL_AUDITORY_RESPONSE);
+        result.trials += count;
+    }
+    
+    const TrialAnalysis& analysis() const { return result; }
+};
+
+// 输出一个模态的信号检测指标
+void printDetection(ostream& out, const SignalDetection& d) {
+    out << fixed << setprecision(1)
+        << "命中率: " << d.hitRate() * 100 << "%  虚报率: " << d.falseAlarmRate() * 100 << "%\n"
+        << setprecision(2)
+        << "辨别力 d′: " << d.dPrime() << "  判断标准 c: " << d.criterion() << "  A′: " << d.aPrime() << "\n";
+}
+
+// 输出逐试次分析：信号检测指标、各间隔的按键率(N 步前相同为匹配，其余为诱饵)和反应时间分布
+void printTrialAnalysis(ostream& out, const TrialAnalysis& analysis, int nValue) {
+    const ModalityAnalysis* modalities[2] = {&analysis.visual, &analysis.auditory};
+    const char* labels[2] = {"视觉", "听觉"};
+    for (int k = 0; k < 2; k++) {
+        const ModalityAnalysis& m = *modalities[k];
+        out << "\n=== " << labels[k] << "逐试次分析 (" << analysis.trials << " 试次) ===\n";
+        printDetection(out, m.detection);
+        
+        out << "与 k 步前相同时的按键率:";
+        for (int lag = 1; lag <= ANALYSIS_MAX_LAG; lag++) {
+            if (m.lagTrials[lag] == 0) continue;
+            out << "  " << lag << (lag == nValue ? "*" : "") << ": " << fixed << setprecision(0)
+                << m.lagResponseRate(lag) * 100 << "%";
+        }
+        out << "  (* 为匹配)\n";
+        
+        const ResponseTimeDistribution* times[2] = {&m.hitTimes, &m.falseAlarmTimes};
+        const char* timeLabels[2] = {"命中", "虚报"};
+        for (int t = 0; t < 2; t++) {
+            const ResponseTimeDistribution& d = *times[t];
+            if (d.count == 0) continue;
+            out << timeLabels[t] << "反应时间: 中位数 " << fixed << setprecision(0) << d.percentile(0.5)
+                << " ms  P90 " << d.percentile(0.9) << " ms  均值 " << d.mean() << "±" << d.standardDeviation()
+                << " ms  (" << d.count << " 次)\n";
+        }
+    }
+}
+
+// 历史成绩存储：每局每个玩家一条记录，按玩家和时间建索引，查询只读取命中的记录
+//
+// 数据 nback_history.dat：文件头 "NBHD"、u32 版本，之后是只追加的记录(u32 负载长度、u32 负载 CRC、负载)
+// 索引 nback_history.idx：文件头 "NBHI"、u32 版本，之后每条记录一个 32 字节定长项：
+//   0 i64 时间(Unix 秒，按追加顺序单调不减)  8 u64 记录在数据文件中的偏移
+//   16 u64 玩家名哈希  24 u32 同一玩家上一项的序号 + 1(0 表示没有)  28 u16 N 值  30 u16 保留
+// 按时间查询直接在索引上二分，按玩家查询顺着同一玩家的链往回走，都是从新到旧。
+// 先写数据再写索引；启动时丢掉指向不完整数据的索引项，再从数据里补上缺失的索引项
+const char* const HISTORY_DATA_FILE = "nback_history.dat";
+const char* const HISTORY_INDEX_FILE = "nback_history.idx";
+const char* const HISTORY_EXPORT_FILE = "nback_history.txt";
+const char HISTORY_DATA_MAGIC[4] = {'N', 'B', 'H', 'D'};
+const char HISTORY_INDEX_MAGIC[4] = {'N', 'B', 'H', 'I'};
+const uint32_t HISTORY_VERSION = 1;
+const size_t HISTORY_HEADER_SIZE = 8;
+const size_t HISTORY_INDEX_ENTRY_SIZE = 32;
+const size_t HISTORY_PAGE_SIZE = 20;
+
+// 一条历史成绩
+struct HistoryRecord {
+    int64_t timestamp;
+    uint64_t sessionId;
+    int playerCount;  // 同场比赛的人数
+    GameStats stats;
+    
+    HistoryRecord() : timestamp(0), sessionId(0), playerCount(1) {}
+};
+
+inline void appendHistoryRecord(string& out, const HistoryRecord& record) {
+    const GameStats& s = record.stats;
+    size_t nameLength = min<size_t>(s.playerName.size(), 0xFFFF);
+    size_t payloadLength = 8 + 8 + 2 + 2 + nameLength + 2 + 11 * 4 + 3 * 8;
+    size_t start = out.size();
+    out.resize(start + 8 + payloadLength);
+    unsigned char* base = (unsigned char*)&out[start];
+    unsigned char* p = base + 8;
+    
+    putLE64(p, (uint64_t)record.timestamp); p += 8;
+    putLE64(p, record.sessionId); p += 8;
+    putLE16(p, (uint16_t)record.playerCount); p += 2;
+    putLE16(p, (uint16_t)nameLength); p += 2;
+    memcpy(p, s.playerName.data(), nameLength); p += nameLength;
+    putLE16(p, (uint16_t)s.nValue); p += 2;
+    const int counters[11] = {s.totalTrials,
+                              s.visualHits, s.visualFalseAlarms, s.visualMisses, s.visualCorrectRejections,
+                              s.auditoryHits, s.auditoryFalseAlarms, s.auditoryMisses, s.auditoryCorrectRejections,
+                              s.visualResponseCount, s.auditoryResponseCount};
+    for (int v : counters) { putLE32(p, (uint32_t)v); p += 4; }
+    putLE64(p, doubleBits(s.responseTimeAvg)); p += 8;
+    putLE64(p, doubleBits(s.visualResponseTimeAvg)); p += 8;
+    putLE64(p, doubleBits(s.auditoryResponseTimeAvg)); p += 8;
+    
+    putLE32(base, (uint32_t)payloadLength);
+    putLE32(base + 4, crc32(base + 8, payloadLength));
+}
+
+// 解析一条历史记录，返回记录总长度；数据不完整或校验失败返回 0
+inline size_t parseHistoryRecord(const unsigned char* data, size_t available, HistoryRecord& record) {
+    if (available < 8) return 0;
+    size_t payloadLength = getLE32(data);
+    if (payloadLength > available - 8 || crc32(data + 8, payloadLength) != getLE32(data + 4)) return 0;
+    const unsigned char* p = data + 8;
+    const unsigned char* end = p + payloadLength;
+    
+    if (end - p < 20) return 0;
+    record.timestamp = (int64_t)getLE64(p); p += 8;
+    record.sessionId = getLE64(p); p += 8;
+    record.playerCount = getLE16(p); p += 2;
+    size_t nameLength = getLE16(p); p += 2;
+    if ((size_t)(end - p) != nameLength + 2 + 11 * 4 + 3 * 8) return 0;
+    
+    GameStats& s = record.stats;
+    s = GameStats();
+    s.playerName.assign((const char*)p, nameLength); p += nameLength;
+    s.nValue = getLE16(p); p += 2;
+    int* counters[11] = {&s.totalTrials,
+                         &s.visualHits, &s.visualFalseAlarms, &s.visualMisses, &s.visualCorrectRejections,
+                         &s.auditoryHits, &s.auditoryFalseAlarms, &s.auditoryMisses, &s.auditoryCorrectRejections,
+                         &s.visualResponseCount, &s.auditoryResponseCount};
+    for (int* v : counters) { *v = (int)getLE32(p); p += 4; }
+    s.responseTimeAvg = bitsToDouble(getLE64(p)); p += 8;
+    s.visualResponseTimeAvg = bitsToDouble(getLE64(p)); p += 8;
+    s.auditoryResponseTimeAvg = bitsToDouble(getLE64(p)); p += 8;
+    s.calculateAccuracies();
+    return 8 + payloadLength;
+}
+
+// 查询条件：各项都可不限
+struct HistoryQuery {
+    string player;   // 为空表示所有玩家
+    int minN;
+    int64_t since;   // Unix 秒，0 表示不限
+    int64_t until;   // 不含，0 表示不限
+    
+    HistoryQuery() : minN(0), since(0), until(0) {}
+};
+
+class HistoryStore {
+private:
+    MappedFile dataMap;
+    MappedFile indexMap;
+    bool mapsStale;              // 追加之后要重新映射才能读到新记录
+    bool opened;
+    uint32_t entryCount;
+    uint64_t dataEnd;            // 数据文件的有效长度
+    int64_t lastTimestamp;
+    map<uint64_t, uint32_t> playerHeads;  // 玩家名哈希 -> 最新一项的序号 + 1
+    
+    static uint64_t nameHash(const string& name) { return fnv1a64(name.data(), name.size()); }
+    
+    static string fileHeader(const char* magic) {
+        string header(HISTORY_HEADER_SIZE, '\0');
+        memcpy(&header[0], magic, 4);
+        putLE32((unsigned char*)&header[4], HISTORY_VERSION);
+        return header;
+    }
+    
+    static bool validHeader(const string& data, const char* magic) {
+        return data.size() >= HISTORY_HEADER_SIZE && memcmp(data.data(), magic, 4) == 0 &&
+               getLE32((const unsigned char*)data.data() + 4) == HISTORY_VERSION;
+    }
+    
+    const unsigned char* entryAt(uint32_t index) const {
+        return indexMap.data() + HISTORY_HEADER_SIZE + (size_t)index * HISTORY_INDEX_ENTRY_SIZE;
+    }
+    
+    void encodeEntry(string& out, const HistoryRecord& record, uint64_t offset) {
+        uint64_t hash = nameHash(record.stats.playerName);
+        auto head = playerHeads.find(hash);
+        lastTimestamp = max(lastTimestamp, record.timestamp);
+        
+        unsigned char e[HISTORY_INDEX_ENTRY_SIZE] = {};
+        putLE64(e, (uint64_t)lastTimestamp);
+        putLE64(e + 8, offset);
+        putLE64(e + 16, hash);
+        putLE32(e + 24, head == playerHeads.end() ? 0 : head->second);
+        putLE16(e + 28, (uint16_t)record.stats.nValue);
+        out.append((const char*)e, sizeof(e));
+        playerHeads[hash] = ++entryCount;
+    }
+    
+    // 重新映射两个文件，索引映射不全时不做查询
+    bool remap() {
+        if (mapsStale) {
+            indexMap.open(HISTORY_INDEX_FILE);
+            dataMap.open(HISTORY_DATA_FILE);
+            mapsStale = false;
+        }
+        return entryCount > 0 &&
+               indexMap.size() >= HISTORY_HEADER_SIZE + (size_t)entryCount * HISTORY_INDEX_ENTRY_SIZE;
+    }
+    
+    // 读出索引项指向的记录
+    bool readRecord(uint32_t index, HistoryRecord& record) const {
+        uint64_t offset = getLE64(entryAt(index) + 8);
+        if (offset >= dataMap.size()) return false;
+        return parseHistoryRecord(dataMap.data() + offset, dataMap.size() - offset, record) > 0;
+    }
+    
+    // 索引里第一个时间 >= t 的项
+    uint32_t lowerBound(int64_t t) const {
+        uint32_t lo = 0, hi = entryCount;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if ((int64_t)getLE64(entryAt(mid)) < t) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    
+public:
+    HistoryStore() : mapsStale(true), opened(false), entryCount(0), dataEnd(0), lastTimestamp(0) {}
+    
+    static HistoryStore& instance() {
+        static HistoryStore store;
+        return store;
+    }
+    
+    // 打开并修复两个文件：截掉写了一半的尾部，补上只写了数据没写索引的记录。
+    // 只读入索引，数据文件只检查最后一个索引项之后的部分
+    void open() {
+        if (opened) return;
+        opened = true;
+        mapsStale = true;
+        
+        if (!dataMap.open(HISTORY_DATA_FILE)) {
+            string existing;
+            if (readWholeFile(HISTORY_DATA_FILE, existing) && !existing.empty()) return;
+            if (!replaceFileDurable(HISTORY_DATA_FILE, fileHeader(HISTORY_DATA_MAGIC)) ||
+                !dataMap.open(HISTORY_DATA_FILE)) {
+                return;
+            }
+        }
+        const unsigned char* d = dataMap.data();
+        size_t dataSize = dataMap.size();
+        if (dataSize < HISTORY_HEADER_SIZE || memcmp(d, HISTORY_DATA_MAGIC, 4) != 0 ||
+            getLE32(d + 4) != HISTORY_VERSION) {
+            return;  // 不是本格式的文件，不去覆盖
+        }
+        
+        string index;
+        readWholeFile(HISTORY_INDEX_FILE, index);
+        bool rewriteIndex = !validHeader(index, HISTORY_INDEX_MAGIC);
+        if (rewriteIndex) index = fileHeader(HISTORY_INDEX_MAGIC);
         
-        if (connect(sock, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-            close(sock);
+        // 从后往前丢掉不指向完整记录的索引项，之后由数据重建
+        size_t entries = (index.size() - HISTORY_HEADER_SIZE) / HISTORY_INDEX_ENTRY_SIZE;
+        const unsigned char* entryBase = (const unsigned char*)index.data() + HISTORY_HEADER_SIZE;
+        HistoryRecord record;
+        dataEnd = HISTORY_HEADER_SIZE;
+        while (entries > 0) {
+            uint64_t offset = getLE64(entryBase + (entries - 1) * HISTORY_INDEX_ENTRY_SIZE + 8);
+            size_t used = offset >= HISTORY_HEADER_SIZE && offset < dataSize ?
+                          parseHistoryRecord(d + offset, dataSize - offset, record) : 0;
+            if (used > 0) {
+                dataEnd = offset + used;
+                break;
+            }
+            entries--;
+        }
+        entryCount = 0;
+        for (size_t i = 0; i < entries; i++) {
+            const unsigned char* e = entryBase + i * HISTORY_INDEX_ENTRY_SIZE;
+            lastTimestamp = max(lastTimestamp, (int64_t)getLE64(e));
+            playerHeads[getLE64(e + 16)] = ++entryCount;
+        }
+        rewriteIndex = rewriteIndex || index.size() != HISTORY_HEADER_SIZE + entries * HISTORY_INDEX_ENTRY_SIZE;
+        index.resize(HISTORY_HEADER_SIZE + entries * HISTORY_INDEX_ENTRY_SIZE);
+        
+        while (dataEnd < dataSize) {
+            size_t used = parseHistoryRecord(d + dataEnd, dataSize - dataEnd, record);
+            if (used == 0) break;
+            encodeEntry(index, record, dataEnd);
+            dataEnd += used;
+            rewriteIndex = true;
+        }
+        if (dataEnd < dataSize) {
+            string data((const char*)d, (size_t)dataEnd);
+            dataMap.close();
+            replaceFileDurable(HISTORY_DATA_FILE, data);
+        }
+        if (rewriteIndex) replaceFileDurable(HISTORY_INDEX_FILE, index);
+    }
+    
+    bool available() const { return opened && dataEnd >= HISTORY_HEADER_SIZE; }
+    
+    size_t size() const { return entryCount; }
+    
+    // 追加一场比赛的全部成绩：先让数据落盘，再写索引
+    bool append(const vector<HistoryRecord>& records) {
+        open();
+        if (!available() || records.empty()) return false;
+        string data;
+        string index;
+        uint64_t offset = dataEnd;
+        uint32_t entriesBefore = entryCount;
+        map<uint64_t, uint32_t> headsBefore = playerHeads;
+        int64_t timestampBefore = lastTimestamp;
+        for (const HistoryRecord& record : records) {
+            size_t before = data.size();
+            appendHistoryRecord(data, record);
+            encodeEntry(index, record, offset);
+            offset += data.size() - before;
+        }
+        if (!writeFileDurable(HISTORY_DATA_FILE, data, true) ||
+            !writeFileDurable(HISTORY_INDEX_FILE, index, true)) {
+            entryCount = entriesBefore;
+            playerHeads.swap(headsBefore);
+            lastTimestamp = timestampBefore;
+            opened = false;   // 下次打开时按文件实际内容修复
             return false;
         }
-#endif
-        isConnected = true;
-        cout << "已连接到服务器 " << ip << ":" << port << "\n";
+        dataEnd = offset;
+        mapsStale = true;
         return true;
     }
     
-    void disconnect() {
-        if (isConnected) {
-#ifdef _WIN32
-            closesocket(sock);
-#else
-            close(sock);
-#endif
-            isConnected = false;
+    // 查询的起始游标(下一个要检查的索引项序号 + 1，0 表示没有更多)
+    uint32_t begin(const HistoryQuery& query) {
+        open();
+        if (!remap()) return 0;
+        if (!query.player.empty()) {
+            auto head = playerHeads.find(nameHash(query.player));
+            if (head == playerHeads.end()) return 0;
+            uint32_t cursor = head->second;
+            // 玩家链从新到旧，先跳过结束时间之后的项
+            while (query.until != 0 && cursor != 0 &&
+                   (int64_t)getLE64(entryAt(cursor - 1)) >= query.until) {
+                cursor = getLE32(entryAt(cursor - 1) + 24);
+            }
+            return cursor;
         }
+        return query.until != 0 ? lowerBound(query.until) : entryCount;
     }
     
-    bool sendData(const string& data) {
-        if (!isConnected) return false;
-        
-        string sizeStr = to_string(data.length()) + "\n";
-#ifdef _WIN32
-        send(sock, sizeStr.c_str(), sizeStr.length(), 0);
-        send(sock, data.c_str(), data.length(), 0);
-        return true;
-#else
-        write(sock, sizeStr.c_str(), sizeStr.length());
-        write(sock, data.c_str(), data.length());
-        return true;
-#endif
+    // 从游标处往旧的方向取最多 limit 条符合条件的记录，返回下一页的游标
+    uint32_t fetch(const HistoryQuery& query, uint32_t cursor, size_t limit, vector<HistoryRecord>& out) {
+        if (!remap()) return 0;
+        cursor = min(cursor, entryCount);
+        uint64_t hash = query.player.empty() ? 0 : nameHash(query.player);
+        while (cursor != 0 && out.size() < limit) {
+            const unsigned char* e = entryAt(cursor - 1);
+            if (query.since != 0 && (int64_t)getLE64(e) < query.since) return 0;
+            uint32_t next = query.player.empty() ? cursor - 1 : getLE32(e + 24);
+            
+            HistoryRecord record;
+            if (getLE16(e + 28) >= query.minN && (hash == 0 || getLE64(e + 16) == hash) &&
+                readRecord(cursor - 1, record) &&
+                (query.player.empty() || record.stats.playerName == query.player)) {
+                out.push_back(record);
+            }
+            cursor = next;
+        }
+        return cursor;
     }
     
-    string receiveData() {
-        if (!isConnected) return "";
-        
-        char buffer[1024];
-        string data;
-        
-#ifdef _WIN32
-        int bytesReceived = recv(sock, buffer, sizeof(buffer), 0);
-        if (bytesReceived > 0) {
-            buffer[bytesReceived] = '\0';
-            data = buffer;
-        }
-#else
-        int bytesReceived = read(sock, buffer, sizeof(buffer)-1);
-        if (bytesReceived > 0) {
-            buffer[bytesReceived] = '\0';
-            data = buffer;
+    // 离线扫描：先调用 prepareScan()，之后 scanRange 只读映射，可在多个线程里同时调用
+    bool prepareScan() {
+        open();
+        return remap();
+    }
+    
+    // 第 index 项的玩家名哈希，只读索引(prepareScan 之后可用)
+    uint64_t playerHashAt(uint32_t index) const { return getLE64(entryAt(index) + 16); }
+    
+    // 按时间顺序访问 [begin, end) 项的记录，visit(序号, 记录)
+    template <typename Visitor>
+    void scanRange(uint32_t begin, uint32_t end, Visitor visit) const {
+        HistoryRecord record;
+        for (uint32_t i = begin; i < min(end, entryCount); i++) {
+            if (readRecord(i, record)) visit(i, record);
         }
-#endif
-        return data;
     }
     
-    bool isReady() const { return isConnected; }
+    // 按时间顺序遍历全部记录
+    template <typename Visitor>
+    void forEach(Visitor visit) {
+        if (!prepareScan()) return;
+        scanRange(0, entryCount, [&](uint32_t, const HistoryRecord& record) { visit(record); });
+    }
 };
 
-class NBackGame {
-private:
+// 排行榜顺序：总体准确率从高到低
+void sortByAccuracy(vector<GameStats>& stats) {
+    sort(stats.begin(), stats.end(), [](const GameStats& a, const GameStats& b) {
+        return a.overallAccuracy > b.overallAccuracy;
+    });
+}
+
+// 一场比赛的成绩单(文本格式)，按总体准确率排名
+void writeResultsText(ostream& out, time_t when, int nValue, int trials, int playerCount,
+                      vector<GameStats> stats) {
+    char timeStr[100];
+    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&when));
+    
+    out << "\n========================================\n";
+    out << "测试时间: " << timeStr << "\n";
+    out << "N值: " << nValue << "  试次: " << trials << "\n";
+    out << "玩家数量: " << playerCount << "\n\n";
+    
+    sortByAccuracy(stats);
+    
+    for (size_t i = 0; i < stats.size(); i++) {
+        const GameStats& s = stats[i];
+        out << "排名 " << (i + 1) << ": " << s.playerName << "\n";
+        out << "  总体准确率: " << fixed << setprecision(1) << s.overallAccuracy << "%\n";
+        out << "  视觉准确率: " << s.visualAccuracy << "%\n";
+        out << "  听觉准确率: " << s.auditoryAccuracy << "%\n";
+        out << "  响应时间: " << setprecision(0) << s.responseTimeAvg << " ms\n";
+        out << "  视觉: 命中" << s.visualHits << "/漏报" << s.visualMisses
+            << "/虚报" << s.visualFalseAlarms << "\n";
+        out << "  听觉: 命中" << s.auditoryHits << "/漏报" << s.auditoryMisses
+            << "/虚报" << s.auditoryFalseAlarms << "\n\n";
+    }
+}
+
+// 把历史记录导出成原来的文本格式，同一场比赛的成绩写在一起
+bool exportHistoryText(HistoryStore& store, const string& path) {
+    ofstream outFile(path);
+    if (!outFile) return false;
+    vector<GameStats> group;
+    HistoryRecord first;
+    auto flushGroup = [&]() {
+        if (group.empty()) return;
+        writeResultsText(outFile, (time_t)first.timestamp, first.stats.nValue, first.stats.totalTrials,
+                         first.playerCount, group);
+        group.clear();
+    };
+    store.forEach([&](const HistoryRecord& record) {
+        if (group.empty() || record.sessionId != first.sessionId || record.sessionId == 0) {
+            flushGroup();
+            first = record;
+        }
+        group.push_back(record.stats);
+    });
+    flushGroup();
+    return (bool)outFile;
+}
+
+// N-Back 核心：刺激生成、试次推进和计分，不涉及任何控制台输入输出
+class NBackEngine {
+protected:
     int n;
     int totalTrials;
     int currentTrial;
@@ -570,43 +4826,58 @@ private:
     int stimulusDuration;
     int interStimulusInterval;
     
-    vector<Player> players;
     vector<Stimulus> predefinedStimuli;
     bool usePredefinedSequence;
     
-    AchievementSystem achievementSys;
-    NetworkManager network;
-    bool isServer;
+    uint64_t seed;
+    Xoshiro256 rng;
     
 public:
-    NBackGame(int nValue, int trials, int stimDuration = 2000, int isi = 500)
+    NBackEngine(int nValue, int trials, int stimDuration = 2000, int isi = 500)
         : n(nValue), totalTrials(trials), currentTrial(0), gridSize(3),
           stimulusDuration(stimDuration), interStimulusInterval(isi),
-          usePredefinedSequence(false), isServer(false) {
-        srand(static_cast<unsigned>(time(nullptr)));
-        achievementSys.loadPlayerStats();
+          usePredefinedSequence(false), seed(makeSessionSeed()), rng(seed) {}
+    
+    virtual ~NBackEngine() {}
+    
+    // 设置本局种子：相同种子生成完全相同的刺激序列
+    void setSeed(uint64_t newSeed) {
+        seed = newSeed;
+        rng.reseed(seed);
     }
     
-    void addPlayer(const string& name) {
-        Player player;
-        player.name = name;
-        player.isActive = true;
-        
-        // 加载玩家生涯数据
-        PlayerStats* stats = achievementSys.getPlayerStats(name);
-        player.careerStats = *stats;
+    uint64_t getSeed() const { return seed; }
+    
+    // 生成一个刺激。每个试次固定消耗 4 个随机数，同一种子下序列完全一致。
+    // 不匹配时从其余取值中直接抽取，既不会意外匹配也不需要重试
+    static Stimulus drawStimulus(Xoshiro256& rng, const Stimulus* nBackStim, int gridCells) {
+        bool matchVisual = rng.chance(MATCH_PROBABILITY);
+        bool matchAuditory = rng.chance(MATCH_PROBABILITY);
+        uint32_t position = rng.bounded(nBackStim ? gridCells - 1 : gridCells);
+        uint32_t letter = rng.bounded(nBackStim ? 25 : 26);
         
-        players.push_back(player);
+        Stimulus stim;
+        if (nBackStim) {
+            position += (position >= (uint32_t)nBackStim->visualPosition);
+            letter += (letter >= (uint32_t)(nBackStim->auditoryLetter - 'A'));
+            stim.visualPosition = matchVisual ? nBackStim->visualPosition : (int)position;
+            stim.auditoryLetter = matchAuditory ? nBackStim->auditoryLetter : (char)('A' + letter);
+        } else {
+            stim.visualPosition = (int)position;
+            stim.auditoryLetter = (char)('A' + letter);
+        }
+        return stim;
     }
     
+    // 多人共用的题目：优先从预生成的序列库中直接取一条，
+    // 库中没有这个 (N, 试次) 组合时按相同的匹配数目标现场生成
     void generatePredefinedSequence() {
-        predefinedStimuli.clear();
-        stimulusHistory.clear();
-        
-        for (int i = 0; i < totalTrials; i++) {
-            Stimulus stim = generateStimulus(i);
-            predefinedStimuli.push_back(stim);
-            stimulusHistory.push_back(stim);
+        bool fromLibrary = (gridSize == 3) &&
+            SequenceLibrary::shared().pick(n, totalTrials, rng, predefinedStimuli);
+        if (!fromLibrary) {
+            predefinedStimuli.resize(totalTrials);
+            generateConstrainedSequence(predefinedStimuli.data(), totalTrials, n, gridSize * gridSize,
+                                        MatchTargets::forSession(n, totalTrials), rng);
         }
         
         usePredefinedSequence = true;
@@ -614,68 +4885,214 @@ public:
     }
     
     Stimulus generateStimulus(int trialIndex) {
-        if (usePredefinedSequence && trialIndex < predefinedStimuli.size()) {
+        if (usePredefinedSequence && trialIndex < (int)predefinedStimuli.size()) {
             return predefinedStimuli[trialIndex];
         }
         
-        Stimulus stim;
+        return drawStimulus(rng, trialIndex >= n ? &stimulusHistory[trialIndex - n] : nullptr,
+                            gridSize * gridSize);
+    }
+    
+    static void updatePlayerStats(GameStats& stats, bool visualMatch, bool auditoryMatch,
+                                  const TrialResponse& response) {
+        bool userVisual = response.visual;
+        bool userAuditory = response.auditory;
+        stats.totalTrials++;
+        
+        if (visualMatch && userVisual) stats.visualHits++;
+        else if (visualMatch && !userVisual) stats.visualMisses++;
+        else if (!visualMatch && userVisual) stats.visualFalseAlarms++;
+        else if (!visualMatch && !userVisual) stats.visualCorrectRejections++;
         
-        bool shouldMatchVisual = (trialIndex >= n) && (rand() % 100 < 30);
-        bool shouldMatchAuditory = (trialIndex >= n) && (rand() % 100 < 30);
+        if (auditoryMatch && userAuditory) stats.auditoryHits++;
+        else if (auditoryMatch && !userAuditory) stats.auditoryMisses++;
+        else if (!auditoryMatch && userAuditory) stats.auditoryFalseAlarms++;
+        else if (!auditoryMatch && !userAuditory) stats.auditoryCorrectRejections++;
         
-        if (shouldMatchVisual && trialIndex >= n) {
-            stim.visualPosition = stimulusHistory[trialIndex - n].visualPosition;
-        } else {
-            int attempts = 0;
-            do {
-                stim.visualPosition = rand() % (gridSize * gridSize);
-                attempts++;
-            } while (trialIndex >= n && 
-                    stim.visualPosition == stimulusHistory[trialIndex - n].visualPosition &&
-                    attempts < 10);
+        // 反应时间按模态分别取滑动平均，没有按键的试次不计入
+        if (userVisual && response.visualResponseTime >= 0) {
+            stats.visualResponseCount++;
+            stats.visualResponseTimeAvg += (response.visualResponseTime - stats.visualResponseTimeAvg) /
+                                           stats.visualResponseCount;
+        }
+        if (userAuditory && response.auditoryResponseTime >= 0) {
+            stats.auditoryResponseCount++;
+            stats.auditoryResponseTimeAvg += (response.auditoryResponseTime - stats.auditoryResponseTimeAvg) /
+                                             stats.auditoryResponseCount;
         }
         
-        if (shouldMatchAuditory && trialIndex >= n) {
-            stim.auditoryLetter = stimulusHistory[trialIndex - n].auditoryLetter;
-        } else {
-            int attempts = 0;
-            do {
-                stim.auditoryLetter = 'A' + rand() % 26;
-                attempts++;
-            } while (trialIndex >= n && 
-                    stim.auditoryLetter == stimulusHistory[trialIndex - n].auditoryLetter &&
-                    attempts < 10);
+        int responses = stats.responseCount();
+        if (responses > 0) {
+            stats.responseTimeAvg = (stats.visualResponseTimeAvg * stats.visualResponseCount +
+                                     stats.auditoryResponseTimeAvg * stats.auditoryResponseCount) / responses;
         }
+    }
+    
+    // 开始一轮测试：重置本轮统计和刺激历史
+    void beginSession(GameStats& stats, const string& playerName) {
+        stats = GameStats();
+        stats.playerName = playerName;
+        stats.nValue = n;
         
-        return stim;
+        stimulusHistory.clear();
     }
     
-    void displayGrid(const Stimulus& stim, const string& currentPlayer = "") {
-        cout << "\n";
+    // 运行一个试次：生成刺激、判断匹配、取得响应并计分
+    TrialOutcome runTrial(int trialIndex, ResponseSource& source, GameStats& stats) {
+        currentTrial = trialIndex;
+        
+        TrialOutcome outcome;
+        outcome.stimulus = generateStimulus(trialIndex);
+        stimulusHistory.push_back(outcome.stimulus);
+        
+        outcome.visualMatch = false;
+        outcome.auditoryMatch = false;
+        if (trialIndex >= n) {
+            const Stimulus& nBackStim = stimulusHistory[trialIndex - n];
+            outcome.visualMatch = (outcome.stimulus.visualPosition == nBackStim.visualPosition);
+            outcome.auditoryMatch = (outcome.stimulus.auditoryLetter == nBackStim.auditoryLetter);
+        }
+        
+        outcome.response = source.respond(outcome.stimulus, trialIndex,
+                                          outcome.visualMatch, outcome.auditoryMatch);
+        
+        updatePlayerStats(stats, outcome.visualMatch, outcome.auditoryMatch, outcome.response);
+        return outcome;
+    }
+    
+    // 无头模式：在虚拟时钟上跑完整轮测试，不做任何等待和输出
+    GameStats runHeadlessSession(const string& playerName, ResponseSource& source, VirtualClock& clock) {
+        GameStats stats;
+        beginSession(stats, playerName);
+        
+        for (int i = 0; i < totalTrials; i++) {
+            runTrial(i, source, stats);
+            clock.advance(stimulusDuration + interStimulusInterval);
+        }
+        
+        stats.calculateAccuracies();
+        return stats;
+    }
+    
+    int getN() const { return n; }
+    int getTotalTrials() const { return totalTrials; }
+    int getStimulusDuration() const { return stimulusDuration; }
+};
+
+class NBackGame : public NBackEngine, public NetworkListener {
+private:
+    vector<Player> players;
+    
+    AchievementSystem achievementSys;
+    NetworkManager network;
+    bool isServer;
+    TrialScheduler scheduler;
+    
+    // 主机端：远程玩家，按连接 id
+    struct RemotePlayer {
+        string name;
+        bool connected;
+        bool playing;                     // 本局开始时已在房间里
+        GameStats stats;
+        vector<TrialResponse> responses;  // 每个试次采纳的响应
+        vector<char> answered;
+        TrialEventBlock events;
+        
+        RemotePlayer() : connected(true), playing(false) {}
+    };
+    map<int, RemotePlayer> remotePlayers;
+    bool networkSession;   // 联机对局进行中
+    int closedTrials;      // 主机端：已判分的试次数，之后才到的响应作废
+    uint64_t sessionId;    // 本场比赛的 id，写进试次事件日志的每个块
+    
+    // 客户端：主机发来、等待主循环处理的消息
+    bool stimulusPending;
+    StimulusMessage pendingStimulus;
+    chrono::steady_clock::time_point stimulusArrival;
+    deque<ScoreMessage> pendingScores;
+    bool leaderboardReceived;
+    vector<GameStats> leaderboard;
+    size_t leaderboardPlayers;
+    size_t leaderboardOwnRank;
+    
+    // 键盘玩家：显示刺激并在刺激窗口内读取按键
+    class KeyboardResponder : public ResponseSource {
+    private:
+        NBackGame& game;
+        const string& playerName;
+        
+    public:
+        KeyboardResponder(NBackGame& g, const string& name) : game(g), playerName(name) {}
+        
+        TrialResponse respond(const Stimulus& stim, int trialIndex, bool, bool) override {
+            return game.presentStimulusAndGetResponse(stim, trialIndex, playerName);
+        }
+    };
+    
+    // 无人值守的主机：按计划时刻把刺激发给客户端，刺激窗口内只处理网络，本地不作答
+    class BroadcastResponder : public ResponseSource {
+    private:
+        NBackGame& game;
+        
+    public:
+        explicit BroadcastResponder(NBackGame& g) : game(g) {}
+        
+        TrialResponse respond(const Stimulus& stim, int trialIndex, bool, bool) override {
+            game.scheduler.waitUntil(game.scheduler.plannedOnset(trialIndex));
+            game.scheduler.recordOnset(trialIndex, chrono::steady_clock::now());
+            game.broadcastStimulus(stim, trialIndex);
+            game.serviceNetworkUntil(game.scheduler.plannedOffset(trialIndex));
+            return TrialResponse();
+        }
+    };
+    
+public:
+    NBackGame(int nValue, int trials, int stimDuration = 2000, int isi = 500)
+        : NBackEngine(nValue, trials, stimDuration, isi), isServer(false),
+          scheduler(stimDuration, isi), networkSession(false), closedTrials(0), sessionId(0),
+          stimulusPending(false), leaderboardReceived(false), leaderboardPlayers(0), leaderboardOwnRank(0) {
+        achievementSys.loadPlayerStats();
+        network.setListener(this);
+    }
+    
+    void addPlayer(const string& name) {
+        Player player;
+        player.name = name;
+        player.isActive = true;
+        
+        // 加载玩家生涯数据
+        PlayerStats* stats = achievementSys.getPlayerStats(name);
+        player.careerStats = *stats;
+        
+        players.push_back(player);
+    }
+    
+    void displayGrid(ostream& out, const Stimulus& stim, const string& currentPlayer = "") {
+        out << "\n";
         if (!currentPlayer.empty()) {
-            cout << "当前玩家: " << currentPlayer << "\n";
+            out << "当前玩家: " << currentPlayer << "\n";
         }
-        cout << "试次: " << (currentTrial + 1) << "/" << totalTrials << "  (N=" << n << ")\n";
-        cout << "+-----+-----+-----+\n";
+        out << "试次: " << (currentTrial + 1) << "/" << totalTrials << "  (N=" << n << ")\n";
+        out << "+-----+-----+-----+\n";
         
         for (int row = 0; row < gridSize; row++) {
-            cout << "|";
+            out << "|";
             for (int col = 0; col < gridSize; col++) {
                 int pos = row * gridSize + col;
                 if (pos == stim.visualPosition) {
-                    cout << "  #  |";
+                    out << "  #  |";
                 } else {
-                    cout << "  .  |";
+                    out << "  .  |";
                 }
             }
-            cout << "\n";
+            out << "\n";
             
             if (row < gridSize - 1) {
-                cout << "+-----+-----+-----+\n";
+                out << "+-----+-----+-----+\n";
             }
         }
         
-        cout << "+-----+-----+-----+\n";
+        out << "+-----+-----+-----+\n";
     }
     
     // 远程游戏：启动服务器
@@ -690,208 +5107,379 @@ public:
         return network.connectToServer(ip, port);
     }
     
+    // 远程游戏：客户端告诉主机自己的名字
+    bool joinRemoteRoom(const string& playerName) {
+        if (isServer || !network.isReady()) return false;
+        JoinMessage join;
+        join.playerName = playerName;
+        return network.send(join);
+    }
+    
+    // 网络回调：在 network.service() 里被调用
+    void onClientConnected(int clientId) override {
+        remotePlayers[clientId] = RemotePlayer();
+    }
+    
+    void onClientDisconnected(int clientId) override {
+        auto it = remotePlayers.find(clientId);
+        if (it == remotePlayers.end()) return;
+        // 对局中掉线的玩家保留已有成绩，剩余试次按未作答计
+        if (networkSession && it->second.playing) {
+            it->second.connected = false;
+        } else {
+            remotePlayers.erase(it);
+        }
+    }
+    
+    void onMessage(int clientId, const WireMessage& msg) override {
+        switch (msg.type) {
+        case MSG_JOIN: {
+            JoinMessage join;
+            auto it = remotePlayers.find(clientId);
+            if (isServer && it != remotePlayers.end() && msg.decode(join)) it->second.name = join.playerName;
+            break;
+        }
+        case MSG_RESPONSE: {
+            ResponseMessage reply;
+            auto it = remotePlayers.find(clientId);
+            if (!isServer || !networkSession || it == remotePlayers.end() ||
+                !it->second.playing || !msg.decode(reply)) {
+                break;
+            }
+            acceptRemoteResponse(it->second, reply);
+            break;
+        }
+        case MSG_SETTINGS: {
+            // 客户端采用主机的设置
+            SettingsMessage settings;
+            if (!isServer && msg.decode(settings)) {
+                n = settings.n;
+                totalTrials = settings.totalTrials;
+                stimulusDuration = settings.stimulusDuration;
+                interStimulusInterval = settings.interStimulusInterval;
+                scheduler.configure(stimulusDuration, interStimulusInterval);
+                setSeed(settings.seed);
+            }
+            break;
+        }
+        case MSG_STIMULUS:
+            if (!isServer && msg.decode(pendingStimulus)) {
+                stimulusPending = true;
+                stimulusArrival = chrono::steady_clock::now();
+            }
+            break;
+        case MSG_SCORE: {
+            ScoreMessage score;
+            if (!isServer && msg.decode(score)) pendingScores.push_back(score);
+            break;
+        }
+        case MSG_LEADERBOARD: {
+            LeaderboardMessage board;
+            if (!isServer && msg.decode(board)) {
+                leaderboard = board.entries;
+                leaderboardPlayers = board.playerCount;
+                leaderboardOwnRank = board.ownRank;
+                leaderboardReceived = true;
+            }
+            break;
+        }
+        }
+    }
+    
+    // 主机端：只接受还没判分的试次，每个试次只采纳第一次响应
+    void acceptRemoteResponse(RemotePlayer& remote, const ResponseMessage& reply) {
+        int trial = reply.trialIndex;
+        if (trial < closedTrials || trial > currentTrial || trial >= totalTrials) return;
+        if (remote.answered[trial]) return;
+        remote.answered[trial] = 1;
+        
+        // 反应时间由客户端测量，超出刺激窗口的按键不算
+        TrialResponse response = reply.response;
+        if (response.visualResponseTime < 0 || response.visualResponseTime >= stimulusDuration) {
+            response.visual = false;
+            response.visualResponseTime = -1;
+        }
+        if (response.auditoryResponseTime < 0 || response.auditoryResponseTime >= stimulusDuration) {
+            response.auditory = false;
+            response.auditoryResponseTime = -1;
+        }
+        remote.responses[trial] = response;
+    }
+    
+    // 主机端：试次关闭，给每个远程玩家判分并发回结果
+    void scoreRemoteTrial(int trialIndex, const TrialOutcome& outcome) {
+        for (auto& entry : remotePlayers) {
+            RemotePlayer& remote = entry.second;
+            if (!remote.playing) continue;
+            const TrialResponse& response = remote.responses[trialIndex];
+            updatePlayerStats(remote.stats, outcome.visualMatch, outcome.auditoryMatch, response);
+            TrialOutcome remoteOutcome = outcome;
+            remoteOutcome.response = response;
+            TrialEventLog::instance().record(remote.events, trialIndex, remoteOutcome);
+            if (!remote.connected) continue;
+            
+            ScoreMessage score;
+            score.trialIndex = trialIndex;
+            score.visualMatch = outcome.visualMatch;
+            score.auditoryMatch = outcome.auditoryMatch;
+            score.response = response;
+            score.stats = remote.stats;
+            network.sendTo(entry.first, score);
+        }
+        closedTrials = trialIndex + 1;
+    }
+    
+    // 处理网络直到指定时刻
+    void serviceNetworkUntil(chrono::steady_clock::time_point deadline) {
+        while (network.isReady()) {
+            long long remaining = chrono::duration_cast<chrono::milliseconds>(
+                deadline - chrono::steady_clock::now()).count();
+            if (remaining <= 0) break;
+            network.service((int)remaining);
+        }
+        scheduler.waitUntil(deadline);
+    }
+    
+    // 远程游戏：主机等待玩家加入，网络和键盘在同一个循环里处理，按回车开始
+    void waitForRemotePlayers() {
+        if (!isServer || !network.isReady()) return;
+        RawModeScope rawMode;
+        TerminalSession& term = TerminalSession::instance();
+        ScreenRenderer& screen = ScreenRenderer::instance();
+        clearScreen();
+        term.discardInput();
+        
+        while (true) {
+            network.service(0);
+            
+            ostream& out = screen.beginFrame();
+            out << "=== 等待玩家加入 ===\n\n";
+            out << "已连接: " << remotePlayers.size() << "\n";
+            for (const auto& client : remotePlayers) {
+                out << "  " << (client.second.name.empty() ? "(未命名)" : client.second.name)
+                    << "  " << network.clientAddress(client.first) << "\n";
+            }
+            out << "\n按回车开始游戏...\n";
+            screen.present();
+            
+            if (term.waitForKey(200, network.waitHandle())) {
+                char key = term.getKey();
+                if (key == '\n' || key == '\r') break;
+            }
+        }
+    }
+    
     // 同步游戏设置到所有客户端
     void syncGameSettings() {
-        if (!network.isReady()) return;
+        if (!isServer || !network.isReady()) return;
         
-        stringstream ss;
-        ss << "SETTINGS:" << n << ":" << totalTrials;
-        network.sendData(ss.str());
+        SettingsMessage settings;
+        settings.n = n;
+        settings.totalTrials = totalTrials;
+        settings.stimulusDuration = stimulusDuration;
+        settings.interStimulusInterval = interStimulusInterval;
+        settings.seed = seed;
+        network.send(settings);
     }
     
-    // 接收远程数据
-    void processRemoteData() {
+    // 接收远程数据：处理已到达的消息，最多等待 timeoutMs 毫秒
+    void processRemoteData(int timeoutMs = 0) {
         if (!network.isReady()) return;
-        
-        string data = network.receiveData();
-        if (!data.empty()) {
-            cout << "收到远程数据: " << data << "\n";
-            // 处理接收到的游戏数据
-        }
+        network.service(timeoutMs);
+    }
+    
+    long long onsetErrorOf(int trialIndex) const {
+        const vector<long long>& errors = scheduler.onsetErrors();
+        return trialIndex < (int)errors.size() ? errors[trialIndex] : 0;
     }
     
     GameStats runSinglePlayerTest(Player& player, int playerIndex) {
+        RawModeScope rawMode;
         clearScreen();
         cout << "=== 玩家 " << (playerIndex + 1) << ": " << player.name << " ===\n";
         cout << "准备开始测试，按任意键继续...";
-        cin.ignore();
-        cin.get();
-        
-        player.currentStats = GameStats();
-        player.currentStats.playerName = player.name;
-        player.currentStats.nValue = n;
-        player.currentStats.totalTrials = totalTrials;
+        waitAnyKey();
         
-        stimulusHistory.clear();
-        
-        // 如果是客户端，同步设置
-        if (!isServer && network.isReady()) {
-            syncGameSettings();
-        }
+        beginSession(player.currentStats, player.name);
+        TrialEventLog& eventLog = TrialEventLog::instance();
+        TrialEventBlock events(sessionId, player.name, n, seed);
+        events.reserve(totalTrials);
         
+        // 反馈显示在刺激间隔内，下一个刺激按计划时刻出现
+        KeyboardResponder keyboard(*this, player.name);
+        scheduler.start();
         for (int i = 0; i < totalTrials; i++) {
-            currentTrial = i;
-            
-            Stimulus currentStim = generateStimulus(i);
-            stimulusHistory.push_back(currentStim);
-            
-            bool visualMatch = false;
-            bool auditoryMatch = false;
-            if (i >= n) {
-                Stimulus nBackStim = stimulusHistory[i - n];
-                visualMatch = (currentStim.visualPosition == nBackStim.visualPosition);
-                auditoryMatch = (currentStim.auditoryLetter == nBackStim.auditoryLetter);
-            }
-            
-            auto startTime = chrono::steady_clock::now();
-            auto responses = presentStimulusAndGetResponse(currentStim, i, player.name);
-            auto endTime = chrono::steady_clock::now();
-            
-            long responseTime = chrono::duration_cast<chrono::milliseconds>(
-                endTime - startTime).count();
+            TrialOutcome outcome = runTrial(i, keyboard, player.currentStats);
+            eventLog.record(events, i, outcome, onsetErrorOf(i));
             
-            bool userVisual = responses.first;
-            bool userAuditory = responses.second;
-            
-            updatePlayerStats(player.currentStats, visualMatch, auditoryMatch, 
-                             userVisual, userAuditory, responseTime);
-            
-            displayFeedback(i, visualMatch, auditoryMatch, userVisual, userAuditory);
-            
-            this_thread::sleep_for(chrono::milliseconds(500));
+            displayFeedback(i, outcome.visualMatch, outcome.auditoryMatch,
+                            outcome.response.visual, outcome.response.auditory);
         }
+        TrialAnalyzer analyzer;
+        analyzer.add(events);
+        eventLog.submit(events);
+        scheduler.waitUntil(scheduler.plannedOnset(totalTrials));
         
         player.currentStats.calculateAccuracies();
         
         // 更新成就系统
         achievementSys.updatePlayerStats(player.careerStats, player.currentStats);
-        vector<string> newAchievements = achievementSys.checkAchievements(player.careerStats, player.currentStats);
+        vector<string> newAchievements = achievementSys.checkAchievements(player.careerStats, player.currentStats,
+                                                                          players.size() > 1);
         
-        showPlayerResults(player.currentStats, newAchievements);
+        showPlayerResults(player.currentStats, newAchievements, &analyzer.analysis());
         
         cout << "\n按任意键继续...";
-        cin.ignore();
-        cin.get();
+        waitAnyKey();
         
         return player.currentStats;
     }
     
-    pair<bool, bool> presentStimulusAndGetResponse(const Stimulus& stim, int trialIndex, 
-                                                   const string& playerName) {
-        clearScreen();
-        cout << "=== 玩家: " << playerName << " ===\n";
-        
-        displayGrid(stim, playerName);
-        
-        cout << "\n听觉刺激: " << stim.auditoryLetter << "\n";
-        cout << "\n";
+    TrialResponse presentStimulusAndGetResponse(const Stimulus& stim, int trialIndex,
+                                                const string& playerName) {
+        // 等到计划时刻再出现，截止时刻按计划计算，即使出现晚了也不会推迟后面的试次
+        scheduler.waitUntil(scheduler.plannedOnset(trialIndex));
         
-        cout << "提示:\n";
-        cout << "  - 视觉匹配(N=" << n << "步前): 按 'V' 键\n";
-        cout << "  - 听觉匹配(N=" << n << "步前): 按 'A' 键\n";
-        cout << "  - 同时匹配: 两个键都按\n";
-        cout << "\n";
-        
-        if (trialIndex < n) {
-            cout << "注意: 前 " << n << " 次刺激没有参照，无需按键!\n";
-        }
-        
-        bool userVisualResponse = false;
-        bool userAuditoryResponse = false;
+        if (networkSession && isServer) broadcastStimulus(stim, trialIndex);
+        return collectResponse(stim, trialIndex, playerName, scheduler.plannedOffset(trialIndex), true);
+    }
+    
+    // 联机对局：刺激出现时同时发给所有客户端
+    void broadcastStimulus(const Stimulus& stim, int trialIndex) {
+        StimulusMessage msg;
+        msg.trialIndex = trialIndex;
+        msg.stimulus = stim;
+        msg.durationMs = stimulusDuration;
+        network.send(msg);
+    }
+    
+    // 显示刺激并读取按键直到 deadline；scheduled 为 true 时把实际出现时刻记入调度器
+    TrialResponse collectResponse(const Stimulus& stim, int trialIndex, const string& playerName,
+                                  chrono::steady_clock::time_point deadline, bool scheduled) {
+        TrialResponse response;
+        bool& userVisualResponse = response.visual;
+        bool& userAuditoryResponse = response.auditory;
         
-        auto startTime = chrono::steady_clock::now();
-        while (chrono::duration_cast<chrono::milliseconds>(
-                chrono::steady_clock::now() - startTime).count() < stimulusDuration) {
+        // 刺激画面和倒计时作为同一帧输出，每次刷新只改写变化的部分
+        ScreenRenderer& screen = ScreenRenderer::instance();
+        auto renderFrame = [&](long remaining) {
+            ScopedTimer timer(PROBE_RENDER);
+            ostream& out = screen.beginFrame();
+            out << "=== 玩家: " << playerName << " ===\n";
             
-            char key = getKeyInput();
-            if (key == 'v' || key == 'V') {
-                userVisualResponse = true;
-            }
-            if (key == 'a' || key == 'A') {
-                userAuditoryResponse = true;
-            }
+            displayGrid(out, stim, playerName);
             
-            auto elapsed = chrono::duration_cast<chrono::milliseconds>(
-                chrono::steady_clock::now() - startTime).count();
-            int remaining = stimulusDuration - elapsed;
+            out << "\n听觉刺激: " << stim.auditoryLetter << "\n";
+            out << "\n";
             
-            cout << "\r剩余时间: " << setw(4) << remaining << " ms  ";
-            if (userVisualResponse) cout << " [V]";
-            if (userAuditoryResponse) cout << " [A]";
-            cout << "      ";
+            out << "提示:\n";
+            out << "  - 视觉匹配(N=" << n << "步前): 按 'V' 键\n";
+            out << "  - 听觉匹配(N=" << n << "步前): 按 'A' 键\n";
+            out << "  - 同时匹配: 两个键都按\n";
+            out << "\n";
             
-            this_thread::sleep_for(chrono::milliseconds(50));
-        }
-        
-#ifdef _WIN32
-        while (_kbhit()) _getch();
-#else
-        tcflush(STDIN_FILENO, TCIFLUSH);
-#endif
-        
-        cout << "\n";
-        return {userVisualResponse, userAuditoryResponse};
-    }
-    
-    void updatePlayerStats(GameStats& stats, bool visualMatch, bool auditoryMatch, 
-                          bool userVisual, bool userAuditory, long responseTime) {
-        stats.totalTrials++;
-        
-        if (visualMatch && userVisual) stats.visualHits++;
-        else if (visualMatch && !userVisual) stats.visualMisses++;
-        else if (!visualMatch && userVisual) stats.visualFalseAlarms++;
-        else if (!visualMatch && !userVisual) stats.visualCorrectRejections++;
-        
-        if (auditoryMatch && userAuditory) stats.auditoryHits++;
-        else if (auditoryMatch && !userAuditory) stats.auditoryMisses++;
-        else if (!auditoryMatch && userAuditory) stats.auditoryFalseAlarms++;
-        else if (!auditoryMatch && !userAuditory) stats.auditoryCorrectRejections++;
+            if (trialIndex < n) {
+                out << "注意: 前 " << n << " 次刺激没有参照，无需按键!\n";
+            }
+            
+            out << "剩余时间: " << setw(4) << remaining << " ms  ";
+            if (userVisualResponse) out << " [V]";
+            if (userAuditoryResponse) out << " [A]";
+            screen.present();
+        };
         
-        if (stats.totalTrials > 1) {
-            stats.responseTimeAvg = (stats.responseTimeAvg * (stats.totalTrials - 1) + responseTime) / stats.totalTrials;
-        } else {
-            stats.responseTimeAvg = responseTime;
+        // 刺激出现前按下的键不计入本次刺激
+        TerminalSession& term = TerminalSession::instance();
+        RawModeScope rawMode;
+        term.discardInput();
+        
+        // 第一帧写出后立即记下实际出现时刻，反应时间都从这里算起
+        renderFrame(max<long long>(0, chrono::duration_cast<chrono::milliseconds>(
+            deadline - chrono::steady_clock::now()).count()));
+        auto onsetTime = chrono::steady_clock::now();
+        if (scheduled) scheduler.recordOnset(trialIndex, onsetTime);
+        
+        // 阻塞等待按键或倒计时刷新，不再固定 50ms 轮询
+        long remaining = chrono::duration_cast<chrono::milliseconds>(deadline - onsetTime).count();
+        while (remaining > 0) {
+            // 下一次唤醒：倒计时显示跳到下一个刻度，或到达截止时间
+            long untilTick = remaining % COUNTDOWN_TICK_MS;
+            if (untilTick == 0) untilTick = COUNTDOWN_TICK_MS;
+            
+            // 联机对局中网络消息也会唤醒
+            int wakeFd = networkSession ? network.waitHandle() : -1;
+            if (term.waitForKey((int)min(remaining, untilTick), wakeFd)) {
+                KeyEvent event;
+                while (term.getKeyEvent(event)) {
+                    if (event.time >= deadline) continue;
+                    long rt = (long)chrono::duration_cast<chrono::milliseconds>(
+                        event.time - onsetTime).count();
+                    if ((event.key == 'v' || event.key == 'V') && !userVisualResponse) {
+                        userVisualResponse = true;
+                        response.visualResponseTime = rt;
+                    }
+                    if ((event.key == 'a' || event.key == 'A') && !userAuditoryResponse) {
+                        userAuditoryResponse = true;
+                        response.auditoryResponseTime = rt;
+                    }
+                }
+            }
+            if (networkSession) network.service(0);
+            
+            remaining = chrono::duration_cast<chrono::milliseconds>(
+                deadline - chrono::steady_clock::now()).count();
+            if (remaining < 0) remaining = 0;
+            renderFrame(remaining);
         }
+        
+        term.discardInput();
+        
+        return response;
     }
     
     void displayFeedback(int trialIndex, bool visualMatch, bool auditoryMatch,
                          bool userVisual, bool userAuditory) {
-        clearScreen();
-        cout << "=== 结果反馈 ===\n";
-        cout << "试次: " << (trialIndex + 1) << "/" << totalTrials << "\n";
+        ScreenRenderer& screen = ScreenRenderer::instance();
+        ostream& out = screen.beginFrame();
+        out << "=== 结果反馈 ===\n";
+        out << "试次: " << (trialIndex + 1) << "/" << totalTrials << "\n";
         
         if (trialIndex >= n) {
-            cout << "\n实际匹配情况:\n";
-            cout << "  视觉: " << (visualMatch ? "匹配 [V]" : "不匹配 [X]") << "\n";
-            cout << "  听觉: " << (auditoryMatch ? "匹配 [V]" : "不匹配 [X]") << "\n";
+            out << "\n实际匹配情况:\n";
+            out << "  视觉: " << (visualMatch ? "匹配 [V]" : "不匹配 [X]") << "\n";
+            out << "  听觉: " << (auditoryMatch ? "匹配 [V]" : "不匹配 [X]") << "\n";
             
-            cout << "\n你的响应:\n";
-            cout << "  视觉: " << (userVisual ? "是 [V]" : "否 [X]") << "\n";
-            cout << "  听觉: " << (userAuditory ? "是 [V]" : "否 [X]") << "\n";
+            out << "\n你的响应:\n";
+            out << "  视觉: " << (userVisual ? "是 [V]" : "否 [X]") << "\n";
+            out << "  听觉: " << (userAuditory ? "是 [V]" : "否 [X]") << "\n";
             
-            cout << "\n结果:\n";
+            out << "\n结果:\n";
             bool visualCorrect = (visualMatch == userVisual);
             bool auditoryCorrect = (auditoryMatch == userAuditory);
             
-            cout << "  视觉: " << (visualCorrect ? "正确! [V]" : "错误! [X]") << "\n";
-            cout << "  听觉: " << (auditoryCorrect ? "正确! [V]" : "错误! [X]") << "\n";
+            out << "  视觉: " << (visualCorrect ? "正确! [V]" : "错误! [X]") << "\n";
+            out << "  听觉: " << (auditoryCorrect ? "正确! [V]" : "错误! [X]") << "\n";
             
             if (visualCorrect && auditoryCorrect) {
-                cout << "\n优秀! 双项正确!\n";
+                out << "\n优秀! 双项正确!\n";
             } else if (visualCorrect || auditoryCorrect) {
-                cout << "\n不错! 一项正确!\n";
+                out << "\n不错! 一项正确!\n";
             } else {
-                cout << "\n继续努力!\n";
+                out << "\n继续努力!\n";
             }
         } else {
-            cout << "\n(前 " << n << " 次刺激是热身，不计分)\n";
+            out << "\n(前 " << n << " 次刺激是热身，不计分)\n";
         }
         
-        cout << "\n下一个刺激将在 1 秒后出现...\n";
-        this_thread::sleep_for(chrono::milliseconds(1000));
+        if (trialIndex + 1 < totalTrials) {
+            out << "\n下一个刺激将在 " << interStimulusInterval << " 毫秒后出现...\n";
+        }
+        screen.present();
     }
     
-    void showPlayerResults(const GameStats& stats, const vector<string>& newAchievements) {
+    // analysis 非空时附上逐试次分析(间隔按键率、反应时间分布)
+    void showPlayerResults(const GameStats& stats, const vector<string>& newAchievements,
+                           const TrialAnalysis* analysis = nullptr) {
         clearScreen();
         cout << "========================================\n";
         cout << "       " << stats.playerName << " 的个人成绩\n";
@@ -899,6 +5487,8 @@ public:
         cout << "N值: " << stats.nValue << "\n";
         cout << "总试次: " << stats.totalTrials << "\n";
         cout << "平均响应时间: " << fixed << setprecision(0) << stats.responseTimeAvg << " ms\n";
+        cout << "视觉反应时间: " << stats.visualResponseTimeAvg << " ms (" << stats.visualResponseCount << " 次)\n";
+        cout << "听觉反应时间: " << stats.auditoryResponseTimeAvg << " ms (" << stats.auditoryResponseCount << " 次)\n";
         cout << "\n";
         
         // 显示新获得的成就
@@ -922,12 +5512,9 @@ public:
             cout << "虚报: " << stats.visualFalseAlarms << "\n";
             cout << "正确拒绝: " << stats.visualCorrectRejections << "\n";
             
-            double visualHitRate = (stats.visualHits + stats.visualMisses > 0) ?
-                stats.visualHits * 100.0 / (stats.visualHits + stats.visualMisses) : 0;
-            
             cout << fixed << setprecision(1);
             cout << "视觉准确率: " << stats.visualAccuracy << "%\n";
-            cout << "视觉命中率: " << visualHitRate << "%\n";
+            printDetection(cout, SignalDetection::visualOf(stats));
         }
         
         if (auditoryTotalResponses > 0) {
@@ -937,15 +5524,26 @@ public:
             cout << "虚报: " << stats.auditoryFalseAlarms << "\n";
             cout << "正确拒绝: " << stats.auditoryCorrectRejections << "\n";
             
-            double auditoryHitRate = (stats.auditoryHits + stats.auditoryMisses > 0) ?
-                stats.auditoryHits * 100.0 / (stats.auditoryHits + stats.auditoryMisses) : 0;
-            
+            cout << fixed << setprecision(1);
             cout << "听觉准确率: " << stats.auditoryAccuracy << "%\n";
-            cout << "听觉命中率: " << auditoryHitRate << "%\n";
+            printDetection(cout, SignalDetection::auditoryOf(stats));
+        }
+        
+        if (analysis) {
+            printTrialAnalysis(cout, *analysis, stats.nValue);
         }
         
         cout << "\n=== 总体表现 ===\n";
-        cout << "总体准确率: " << stats.overallAccuracy << "%\n";
+        cout << "总体准确率: " << setprecision(1) << stats.overallAccuracy << "%\n";
+        
+        GlobalLeaderboard& board = GlobalLeaderboard::instance();
+        for (int m = 0; m < BOARD_METRIC_COUNT; m++) {
+            size_t rank = board.rank(stats.nValue, (BoardMetric)m, stats.playerName);
+            if (rank > 0) {
+                cout << "全球排名(N=" << stats.nValue << " " << BOARD_METRIC_NAMES[m] << "): 第 " << rank
+                     << " 名 / 共 " << board.size(stats.nValue, (BoardMetric)m) << " 人\n";
+            }
+        }
         
         if (stats.overallAccuracy > 90) {
             cout << "评价: 记忆大师!\n";
@@ -968,6 +5566,8 @@ public:
             return;
         }
         
+        // 整场比赛保持原始模式，避免每次读键都切换终端设置
+        RawModeScope rawMode;
         clearScreen();
         cout << "=== 多人 N-Back 挑战赛 ===\n";
         cout << "玩家列表 (" << players.size() << "人):\n";
@@ -977,17 +5577,11 @@ public:
         cout << "\nN值: " << n << "  试次: " << totalTrials << "\n";
         cout << "\n所有玩家将使用相同的题目进行测试！\n";
         cout << "\n按任意键开始测试...";
-        cin.ignore();
-        cin.get();
-        
-        // 更新成就：多人游戏
-        for (Player& player : players) {
-            if (player.careerStats.achievements[ACH_MULTIPLAYER] == 0) {
-                player.careerStats.achievements[ACH_MULTIPLAYER] = 1;
-            }
-        }
+        waitAnyKey();
         
         generatePredefinedSequence();
+        TimingProbes::instance().reset();
+        sessionId = makeSessionSeed();
         
         vector<GameStats> allStats;
         for (size_t i = 0; i < players.size(); i++) {
@@ -996,42 +5590,303 @@ public:
         }
         
         showLeaderboard(allStats);
-        saveResultsToFile(allStats);
+        saveResults(allStats);
+        
+        // 本场比赛的计时数据
+        stringstream label;
+        label << "multiplayer n=" << n << " trials=" << totalTrials << " players=" << players.size();
+        cout << "\n计时数据:\n";
+        TimingProbes::instance().dump(cout);
+        if (TimingProbes::instance().appendJsonLine("nback_timing.jsonl", label.str())) {
+            cout << "计时数据已追加到 nback_timing.jsonl 文件\n";
+        }
+    }
+    
+    // 主机端：房间里已连接的远程玩家加入本局并收到设置，返回参赛的远程玩家数
+    int beginRemoteSession() {
+        int remoteCount = 0;
+        for (auto& entry : remotePlayers) {
+            RemotePlayer& remote = entry.second;
+            remote.playing = remote.connected;
+            if (!remote.playing) continue;
+            beginSession(remote.stats, remote.name.empty() ? network.clientAddress(entry.first) : remote.name);
+            remote.responses.assign(totalTrials, TrialResponse());
+            remote.answered.assign(totalTrials, 0);
+            remote.events = TrialEventBlock(sessionId, remote.stats.playerName, n, seed);
+            remoteCount++;
+        }
+        closedTrials = 0;
+        networkSession = true;
+        syncGameSettings();
+        return remoteCount;
+    }
+    
+    // 主机端：把远程玩家的成绩追加到 allStats，再给每个客户端发排行榜：
+    // 前 LEADERBOARD_WIRE_TOP 名，名次在这之后的客户端附上自己那一行
+    void finishRemoteSession(vector<GameStats>& allStats) {
+        vector<int> owners(allStats.size(), 0);  // 每行所属的连接 id，本地玩家为 0
+        for (auto& entry : remotePlayers) {
+            if (!entry.second.playing) continue;
+            entry.second.stats.calculateAccuracies();
+            allStats.push_back(entry.second.stats);
+            owners.push_back(entry.first);
+        }
+        
+        vector<size_t> order(allStats.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return allStats[a].overallAccuracy > allStats[b].overallAccuracy;
+        });
+        
+        LeaderboardMessage board;
+        board.playerCount = (uint32_t)allStats.size();
+        size_t top = min(order.size(), LEADERBOARD_WIRE_TOP);
+        for (size_t i = 0; i < top; i++) board.entries.push_back(allStats[order[i]]);
+        for (size_t rank = 0; rank < order.size(); rank++) {
+            int clientId = owners[order[rank]];
+            if (clientId == 0 || !remotePlayers[clientId].connected) continue;
+            if (rank < top) {
+                board.ownRank = 0;
+                network.sendTo(clientId, board);
+                continue;
+            }
+            board.entries.push_back(allStats[order[rank]]);
+            board.ownRank = (uint32_t)(rank + 1);
+            network.sendTo(clientId, board);
+            board.entries.pop_back();
+        }
+        network.service(0);
+    }
+    
+    // 远程联机(主机)：主机和房间里的所有玩家同时作答同一个试次，由主机统一判分
+    void runNetworkedGame() {
+        if (!isServer || !network.isReady() || players.empty()) return;
+        Player& host = players[0];
+        RawModeScope rawMode;
+        
+        generatePredefinedSequence();
+        TimingProbes::instance().reset();
+        sessionId = makeSessionSeed();
+        
+        int remoteCount = beginRemoteSession();
+        beginSession(host.currentStats, host.name);
+        TrialEventLog& eventLog = TrialEventLog::instance();
+        TrialEventBlock hostEvents(sessionId, host.name, n, seed);
+        
+        clearScreen();
+        cout << "=== 联机 N-Back 挑战赛 ===\n";
+        cout << "玩家: " << (remoteCount + 1) << " 人  N值: " << n << "  试次: " << totalTrials << "\n";
+        cout << "\n所有玩家同时作答，比赛即将开始...\n";
+        cout.flush();
+        
+        // 留出时间让客户端收到设置
+        KeyboardResponder keyboard(*this, host.name);
+        scheduler.start(chrono::steady_clock::now() + chrono::milliseconds(NETWORK_START_DELAY_MS));
+        for (int i = 0; i < totalTrials; i++) {
+            serviceNetworkUntil(scheduler.plannedOnset(i));
+            TrialOutcome outcome = runTrial(i, keyboard, host.currentStats);
+            eventLog.record(hostEvents, i, outcome, onsetErrorOf(i));
+            
+            displayFeedback(i, outcome.visualMatch, outcome.auditoryMatch,
+                            outcome.response.visual, outcome.response.auditory);
+            
+            // 刺激间隔过半时关闭本试次，给远程响应留出传输时间
+            serviceNetworkUntil(scheduler.plannedOffset(i) + chrono::milliseconds(interStimulusInterval / 2));
+            scoreRemoteTrial(i, outcome);
+        }
+        serviceNetworkUntil(scheduler.plannedOnset(totalTrials));
+        networkSession = false;
+        TrialAnalyzer hostAnalyzer;
+        hostAnalyzer.add(hostEvents);
+        eventLog.submit(hostEvents);
+        for (auto& entry : remotePlayers) {
+            if (entry.second.playing) eventLog.submit(entry.second.events);
+        }
+        
+        vector<GameStats> allStats;
+        host.currentStats.calculateAccuracies();
+        allStats.push_back(host.currentStats);
+        finishRemoteSession(allStats);
+        
+        achievementSys.updatePlayerStats(host.careerStats, host.currentStats);
+        vector<string> newAchievements = achievementSys.checkAchievements(host.careerStats, host.currentStats, true);
+        showPlayerResults(host.currentStats, newAchievements, &hostAnalyzer.analysis());
+        cout << "\n按任意键查看排行榜...";
+        waitAnyKey();
+        
+        showLeaderboard(allStats);
+        saveResults(allStats);
+        
+        stringstream label;
+        label << "networked n=" << n << " trials=" << totalTrials << " players=" << allStats.size();
+        cout << "\n计时数据:\n";
+        TimingProbes::instance().dump(cout);
+        if (TimingProbes::instance().appendJsonLine("nback_timing.jsonl", label.str())) {
+            cout << "计时数据已追加到 nback_timing.jsonl 文件\n";
+        }
+    }
+    
+    // 负载测试：没有本地玩家的主机，等 expectedPlayers 个客户端报上名字(或超时)后开一局，
+    // 只发刺激、判分和发排行榜，不输出、不写日志和生涯数据；返回远程玩家的成绩
+    vector<GameStats> runHeadlessHost(int expectedPlayers, int joinTimeoutMs) {
+        vector<GameStats> allStats;
+        if (!isServer || !network.isReady()) return allStats;
+        
+        auto joinDeadline = chrono::steady_clock::now() + chrono::milliseconds(joinTimeoutMs);
+        while (network.isReady()) {
+            int joined = 0;
+            for (const auto& entry : remotePlayers) {
+                if (entry.second.connected && !entry.second.name.empty()) joined++;
+            }
+            long long remaining = chrono::duration_cast<chrono::milliseconds>(
+                joinDeadline - chrono::steady_clock::now()).count();
+            if (joined >= expectedPlayers || remaining <= 0) break;
+            network.service((int)remaining);
+        }
+        
+        generatePredefinedSequence();
+        sessionId = makeSessionSeed();
+        beginRemoteSession();
+        
+        GameStats hostStats;
+        beginSession(hostStats, "");
+        BroadcastResponder broadcaster(*this);
+        scheduler.start(chrono::steady_clock::now() + chrono::milliseconds(NETWORK_START_DELAY_MS));
+        for (int i = 0; i < totalTrials; i++) {
+            serviceNetworkUntil(scheduler.plannedOnset(i));
+            TrialOutcome outcome = runTrial(i, broadcaster, hostStats);
+            serviceNetworkUntil(scheduler.plannedOffset(i) + chrono::milliseconds(interStimulusInterval / 2));
+            scoreRemoteTrial(i, outcome);
+        }
+        serviceNetworkUntil(scheduler.plannedOnset(totalTrials));
+        networkSession = false;
+        finishRemoteSession(allStats);
+        
+        // 排行榜可能一次发不完：继续处理网络，直到客户端收完断开或超时
+        auto drainDeadline = chrono::steady_clock::now() + chrono::milliseconds(NETWORK_START_DELAY_MS);
+        while (network.isReady() && network.clientCount() > 0) {
+            long long remaining = chrono::duration_cast<chrono::milliseconds>(
+                drainDeadline - chrono::steady_clock::now()).count();
+            if (remaining <= 0) break;
+            network.service((int)remaining);
+        }
+        return allStats;
+    }
+    
+    // 本局各试次的计划出现时刻和主机端实际出现的偏差(微秒)，供负载测试在对局结束后对照
+    chrono::steady_clock::time_point plannedOnset(int trialIndex) const {
+        return scheduler.plannedOnset(trialIndex);
+    }
+    
+    const vector<long long>& onsetErrors() const { return scheduler.onsetErrors(); }
+    
+    // 远程联机(客户端)：主机发来刺激就作答，成绩以主机的判分为准
+    void runRemoteClientGame() {
+        if (isServer || !network.isReady() || players.empty()) return;
+        Player& player = players[0];
+        RawModeScope rawMode;
+        TerminalSession& term = TerminalSession::instance();
+        
+        clearScreen();
+        cout << "已加入房间，等待主机开始游戏...\n";
+        cout.flush();
+        
+        beginSession(player.currentStats, player.name);
+        networkSession = true;
+        stimulusPending = false;
+        pendingScores.clear();
+        leaderboardReceived = false;
+        
+        while (network.isReady() && !leaderboardReceived) {
+            while (!pendingScores.empty()) {
+                const ScoreMessage& score = pendingScores.front();
+                player.currentStats = score.stats;
+                displayFeedback(score.trialIndex, score.visualMatch, score.auditoryMatch,
+                                score.response.visual, score.response.auditory);
+                pendingScores.pop_front();
+            }
+            
+            if (stimulusPending) {
+                // 窗口从收到刺激时算起，网络延迟不占用作答时间
+                stimulusPending = false;
+                StimulusMessage stim = pendingStimulus;
+                currentTrial = stim.trialIndex;
+                ResponseMessage reply;
+                reply.trialIndex = stim.trialIndex;
+                reply.response = collectResponse(stim.stimulus, stim.trialIndex, player.name,
+                                                 stimulusArrival + chrono::milliseconds(stim.durationMs), false);
+                network.send(reply);
+                continue;
+            }
+            
+            // 刺激之外的按键无效
+            term.waitForKey(COUNTDOWN_TICK_MS, network.waitHandle());
+            term.discardInput();
+            network.service(0);
+        }
+        networkSession = false;
+        
+        if (!leaderboardReceived) {
+            clearScreen();
+            cout << "与主机的连接已断开！\n";
+            cout << "按任意键返回...";
+            waitAnyKey();
+            return;
+        }
+        
+        player.currentStats.calculateAccuracies();
+        achievementSys.updatePlayerStats(player.careerStats, player.currentStats);
+        vector<string> newAchievements = achievementSys.checkAchievements(player.careerStats, player.currentStats, true);
+        showPlayerResults(player.currentStats, newAchievements);
+        cout << "\n按任意键查看排行榜...";
+        waitAnyKey();
+        
+        showLeaderboard(leaderboard, leaderboardPlayers, leaderboardOwnRank);
     }
     
-    void showLeaderboard(const vector<GameStats>& allStats) {
+    // 联机客户端只收到前几名：playerCount 为总人数，ownRank 非 0 时 allStats 最后一行是自己，
+    // 在表格末尾按该名次单独列出
+    void showLeaderboard(const vector<GameStats>& allStats, size_t playerCount = 0, size_t ownRank = 0) {
         clearScreen();
         cout << "========================================\n";
         cout << "       N-Back 挑战赛排行榜\n";
         cout << "========================================\n";
         cout << "N值: " << n << "  总试次: " << totalTrials << "\n";
-        cout << "玩家数量: " << players.size() << "\n\n";
+        cout << "玩家数量: " << max(playerCount, allStats.size()) << "\n\n";
         
         vector<GameStats> sortedStats = allStats;
-        sort(sortedStats.begin(), sortedStats.end(), 
-             [](const GameStats& a, const GameStats& b) {
-                 return a.overallAccuracy > b.overallAccuracy;
-             });
+        GameStats own;
+        if (ownRank > 0 && !sortedStats.empty()) {
+            own = sortedStats.back();
+            sortedStats.pop_back();
+        }
+        sortByAccuracy(sortedStats);
         
         cout << "+-----+--------------------+------------+------------+------------+------------+\n";
         cout << "| 排名 |       玩家        | 总体准确率 | 视觉准确率 | 听觉准确率 | 响应时间(ms) |\n";
         cout << "+-----+--------------------+------------+------------+------------+------------+\n";
         
+        auto printRow = [](const string& medal, const GameStats& stats) {
+            cout << "| " << setw(3) << medal << " | "
+                 << setw(18) << left << stats.playerName << " | "
+                 << setw(10) << right << fixed << setprecision(1) << stats.overallAccuracy << "% | "
+                 << setw(10) << right << stats.visualAccuracy << "% | "
+                 << setw(10) << right << stats.auditoryAccuracy << "% | "
+                 << setw(10) << right << setprecision(0) << stats.responseTimeAvg << " |\n";
+        };
+        
         for (size_t i = 0; i < sortedStats.size(); i++) {
-            const GameStats& stats = sortedStats[i];
-            
             string medal;
             if (i == 0) medal = "1st";
             else if (i == 1) medal = "2nd";
             else if (i == 2) medal = "3rd";
             else medal = to_string(i + 1);
             
-            cout << "| " << setw(3) << medal << " | "
-                 << setw(18) << left << stats.playerName << " | "
-                 << setw(10) << right << fixed << setprecision(1) << stats.overallAccuracy << "% | "
-                 << setw(10) << right << stats.visualAccuracy << "% | "
-                 << setw(10) << right << stats.auditoryAccuracy << "% | "
-                 << setw(10) << right << setprecision(0) << stats.responseTimeAvg << " |\n";
+            printRow(medal, sortedStats[i]);
+        }
+        if (ownRank > 0) {
+            cout << "| ... |                    |            |            |            |            |\n";
+            printRow(to_string(ownRank), own);
         }
         
         cout << "+-----+--------------------+------------+------------+------------+------------+\n";
@@ -1069,44 +5924,22 @@ public:
         }
         
         cout << "\n按任意键返回主菜单...";
-        cin.ignore();
-        cin.get();
+        waitAnyKey();
     }
     
-    void saveResultsToFile(const vector<GameStats>& allStats) {
-        ofstream outFile("nback_results.txt", ios::app);
-        if (!outFile) return;
-        
-        time_t now = time(nullptr);
-        char timeStr[100];
-        strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&now));
-        
-        outFile << "\n========================================\n";
-        outFile << "测试时间: " << timeStr << "\n";
-        outFile << "N值: " << n << "  试次: " << totalTrials << "\n";
-        outFile << "玩家数量: " << players.size() << "\n\n";
-        
-        vector<GameStats> sortedStats = allStats;
-        sort(sortedStats.begin(), sortedStats.end(), 
-             [](const GameStats& a, const GameStats& b) {
-                 return a.overallAccuracy > b.overallAccuracy;
-             });
-        
-        for (size_t i = 0; i < sortedStats.size(); i++) {
-            const GameStats& stats = sortedStats[i];
-            outFile << "排名 " << (i + 1) << ": " << stats.playerName << "\n";
-            outFile << "  总体准确率: " << fixed << setprecision(1) << stats.overallAccuracy << "%\n";
-            outFile << "  视觉准确率: " << stats.visualAccuracy << "%\n";
-            outFile << "  听觉准确率: " << stats.auditoryAccuracy << "%\n";
-            outFile << "  响应时间: " << setprecision(0) << stats.responseTimeAvg << " ms\n";
-            outFile << "  视觉: 命中" << stats.visualHits << "/漏报" << stats.visualMisses 
-                   << "/虚报" << stats.visualFalseAlarms << "\n";
-            outFile << "  听觉: 命中" << stats.auditoryHits << "/漏报" << stats.auditoryMisses 
-                   << "/虚报" << stats.auditoryFalseAlarms << "\n\n";
+    // 本场成绩写入历史记录，同场玩家共用会话 id
+    void saveResults(const vector<GameStats>& allStats) {
+        vector<HistoryRecord> records(allStats.size());
+        int64_t now = (int64_t)time(nullptr);
+        for (size_t i = 0; i < allStats.size(); i++) {
+            records[i].timestamp = now;
+            records[i].sessionId = sessionId;
+            records[i].playerCount = (int)allStats.size();
+            records[i].stats = allStats[i];
+        }
+        if (HistoryStore::instance().append(records)) {
+            cout << "\n成绩已保存到历史记录\n";
         }
-        
-        outFile.close();
-        cout << "\n成绩已保存到 nback_results.txt 文件\n";
     }
     
     // 显示成就系统
@@ -1140,10 +5973,7 @@ void remoteGameMenu() {
         
         NBackGame game(2, 20); // 默认参数
         if (game.startRemoteServer(port)) {
-            cout << "房间创建成功！等待玩家加入...\n";
-            cout << "按任意键开始游戏...";
-            cin.ignore();
-            cin.get();
+            cout << "房间创建成功！\n";
             
             // 添加主机玩家
             string hostName;
@@ -1152,15 +5982,12 @@ void remoteGameMenu() {
             game.addPlayer(hostName);
             
             // 等待其他玩家加入
-            cout << "等待其他玩家加入...\n";
-            // 这里可以添加等待逻辑
-            
-            game.runMultiplayerGame();
+            game.waitForRemotePlayers();
+            game.runNetworkedGame();
         } else {
             cout << "房间创建失败！\n";
             cout << "按任意键返回...";
-            cin.ignore();
-            cin.get();
+            waitAnyKey();
         }
     } else if (choice == 2) {
         string ip;
@@ -1176,18 +6003,184 @@ void remoteGameMenu() {
             cout << "请输入你的名字: ";
             cin >> playerName;
             game.addPlayer(playerName);
-            
-            cout << "等待主机开始游戏...\n";
-            // 这里可以添加等待主机开始的逻辑
-            
-            // 单人游戏模式
-            game.runSinglePlayerTest(*(new Player()), 0);
+            game.joinRemoteRoom(playerName);
+            game.runRemoteClientGame();
         } else {
             cout << "连接服务器失败！\n";
             cout << "按任意键返回...";
-            cin.ignore();
-            cin.get();
+            waitAnyKey();
+        }
+    }
+}
+
+// 分页显示查询结果，每页只读取这一页命中的记录
+void showHistoryPages(HistoryStore& store, const HistoryQuery& query, const string& title) {
+    uint32_t cursor = store.begin(query);
+    size_t shown = 0;
+    while (true) {
+        vector<HistoryRecord> page;
+        cursor = store.fetch(query, cursor, HISTORY_PAGE_SIZE, page);
+        
+        clearScreen();
+        cout << "=== " << title << " ===\n\n";
+        // 表头按显示宽度对齐(setw 按字节计，中文会错位)
+        cout << "时间              玩家            N    试次   总体     视觉     听觉     反应时间\n";
+        for (const HistoryRecord& record : page) {
+            const GameStats& s = record.stats;
+            time_t when = (time_t)record.timestamp;
+            char timeStr[32];
+            strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M", localtime(&when));
+            cout << left << setw(18) << timeStr << setw(16) << s.playerName << setw(5) << s.nValue
+                 << setw(7) << s.totalTrials << fixed << setprecision(1)
+                 << setw(9) << s.overallAccuracy << setw(9) << s.visualAccuracy << setw(9) << s.auditoryAccuracy
+                 << setprecision(0) << s.responseTimeAvg << " ms\n";
+        }
+        cout << right;
+        shown += page.size();
+        
+        if (shown == 0) cout << "没有符合条件的记录。\n";
+        if (cursor == 0) {
+            cout << "\n共 " << shown << " 条。按任意键返回...";
+            waitAnyKey();
+            return;
+        }
+        cout << "\n已显示 " << shown << " 条。按 N 显示下一页，其他键返回...";
+        char key = waitAnyKey();
+        if (key != 'n' && key != 'N') return;
+    }
+}
+
+// 历史成绩菜单
+void historyMenu() {
+    HistoryStore& store = HistoryStore::instance();
+    store.open();
+    
+    clearScreen();
+    cout << "========================================\n";
+    cout << "           历史成绩 (" << store.size() << " 条)\n";
+    cout << "========================================\n";
+    cout << "1. 最近的成绩\n";
+    cout << "2. 按玩家查询\n";
+    cout << "3. 按 N 值和时间查询\n";
+    cout << "4. 导出为文本文件\n";
+    cout << "5. 逐试次分析 (d′、诱饵干扰、反应时间)\n";
+    cout << "6. 返回主菜单\n";
+    cout << "========================================\n";
+    cout << "请选择 (1-6): ";
+    
+    int choice;
+    cin >> choice;
+    
+    HistoryQuery query;
+    if (choice == 1) {
+        showHistoryPages(store, query, "最近的成绩");
+    } else if (choice == 2) {
+        cout << "请输入玩家名字: ";
+        cin >> query.player;
+        showHistoryPages(store, query, "玩家 " + query.player + " 的成绩");
+    } else if (choice == 3) {
+        int range;
+        cout << "最低 N 值: ";
+        cin >> query.minN;
+        cout << "时间范围 (1. 今天  2. 最近 7 天  3. 本月  4. 全部): ";
+        cin >> range;
+        
+        time_t now = time(nullptr);
+        tm start = *localtime(&now);
+        start.tm_hour = start.tm_min = start.tm_sec = 0;
+        if (range == 3) start.tm_mday = 1;
+        if (range == 1 || range == 3) query.since = (int64_t)mktime(&start);
+        if (range == 2) query.since = (int64_t)now - 7 * 24 * 3600;
+        
+        stringstream title;
+        title << "N>=" << query.minN << " 的成绩";
+        showHistoryPages(store, query, title.str());
+    } else if (choice == 4) {
+        if (exportHistoryText(store, HISTORY_EXPORT_FILE)) {
+            cout << "已导出到 " << HISTORY_EXPORT_FILE << "\n";
+        } else {
+            cout << "导出失败！\n";
+        }
+        cout << "按任意键返回...";
+        waitAnyKey();
+    } else if (choice == 5) {
+        string player;
+        int nValue;
+        cout << "请输入玩家名字 (输入 * 表示所有玩家): ";
+        cin >> player;
+        cout << "N 值: ";
+        cin >> nValue;
+        
+        // 一次读入整个日志，只分析符合条件的块
+        vector<TrialEventBlock> blocks;
+        TrialAnalyzer analyzer;
+        long long sessions = 0;
+        if (readTrialEventLog(TRIAL_LOG_FILE, blocks)) {
+            for (const TrialEventBlock& block : blocks) {
+                if (block.n != nValue || (player != "*" && block.playerName != player)) continue;
+                analyzer.add(block);
+                sessions += block.firstTrial == 0;
+            }
+        }
+        
+        clearScreen();
+        cout << "=== " << (player == "*" ? string("所有玩家") : player) << "  N=" << nValue
+             << "  共 " << sessions << " 局 ===\n";
+        if (analyzer.analysis().trials == 0) {
+            cout << "没有符合条件的试次记录。\n";
+        } else {
+            printTrialAnalysis(cout, analyzer.analysis(), nValue);
         }
+        cout << "\n按任意键返回...";
+        waitAnyKey();
+    }
+}
+
+// 全球排行榜菜单：选 N 值和指标，显示前几名，可查任一玩家的名次
+void globalLeaderboardMenu() {
+    GlobalLeaderboard& board = GlobalLeaderboard::instance();
+    clearScreen();
+    cout << "========================================\n";
+    cout << "           全球排行榜\n";
+    cout << "========================================\n";
+    
+    vector<int> levels = board.levels(BOARD_ACCURACY);
+    if (levels.empty()) {
+        cout << "暂无成绩。\n按任意键返回...";
+        waitAnyKey();
+        return;
+    }
+    cout << "已有成绩的 N 值:";
+    for (int level : levels) cout << " " << level;
+    cout << "\n";
+    
+    int nValue, metricChoice;
+    cout << "请输入 N 值: ";
+    cin >> nValue;
+    cout << "排名指标 (1. 总体准确率  2. 反应时间): ";
+    cin >> metricChoice;
+    BoardMetric metric = metricChoice == 2 ? BOARD_RESPONSE_TIME : BOARD_ACCURACY;
+    
+    clearScreen();
+    cout << "=== 全球排行榜  N=" << nValue << "  " << BOARD_METRIC_NAMES[metric]
+         << "  (共 " << board.size(nValue, metric) << " 人) ===\n\n";
+    vector<pair<string, double>> top = board.top(nValue, metric, LEADERBOARD_TOP_COUNT);
+    for (size_t i = 0; i < top.size(); i++) {
+        cout << right << setw(4) << (i + 1) << ". " << left << setw(20) << top[i].first << right
+             << fixed << setprecision(metric == BOARD_ACCURACY ? 1 : 0) << top[i].second
+             << (metric == BOARD_ACCURACY ? "%" : " ms") << "\n";
+    }
+    if (top.empty()) cout << "该 N 值暂无成绩。\n";
+    
+    string playerName;
+    cout << "\n输入玩家名字查看名次 (输入 0 返回): ";
+    cin >> playerName;
+    if (playerName != "0") {
+        size_t rank = board.rank(nValue, metric, playerName);
+        if (rank > 0) cout << playerName << " 排名第 " << rank << " 名\n";
+        else cout << playerName << " 不在该排行榜上\n";
+        cout << "按任意键返回...";
+        waitAnyKey();
     }
 }
 
@@ -1205,8 +6198,7 @@ void achievementSystemMenu() {
     if (playerName.empty()) {
         cout << "玩家名不能为空！\n";
         cout << "按任意键返回...";
-        cin.ignore();
-        cin.get();
+        waitAnyKey();
         return;
     }
     
@@ -1231,14 +6223,15 @@ void showMainMenu() {
         cout << "3. 远程联机游戏\n";
         cout << "4. 成就系统\n";
         cout << "5. 查看历史成绩\n";
-        cout << "6. 关于 N-Back 训练\n";
-        cout << "7. 退出系统\n";
+        cout << "6. 全球排行榜\n";
+        cout << "7. 关于 N-Back 训练\n";
+        cout << "8. 退出系统\n";
         cout << "========================================\n";
-        cout << "请选择 (1-7): ";
+        cout << "请选择 (1-8): ";
         
         cin >> choice;
         
-        if (choice == 7) {
+        if (choice == 8) {
             cout << "再见! 坚持训练有助于提升记忆力!\n";
             break;
         }
@@ -1300,22 +6293,14 @@ void showMainMenu() {
                 break;
             }
             case 5: {
-                ifstream inFile("nback_results.txt");
-                if (!inFile) {
-                    cout << "暂无历史成绩记录。\n";
-                } else {
-                    string line;
-                    while (getline(inFile, line)) {
-                        cout << line << "\n";
-                    }
-                    inFile.close();
-                }
-                cout << "\n按任意键返回...";
-                cin.ignore();
-                cin.get();
+                historyMenu();
                 break;
             }
             case 6: {
+                globalLeaderboardMenu();
+                break;
+            }
+            case 7: {
                 clearScreen();
                 cout << "========================================\n";
                 cout << "         关于 N-Back 训练\n";
@@ -1328,37 +6313,352 @@ void showMainMenu() {
                 cout << "成就系统: 解锁各种记忆相关成就\n";
                 cout << "远程联机: 与朋友在线比拼记忆力\n";
                 cout << "生涯统计: 追踪你的进步历程\n";
+                cout << "全球排行榜: 按 N 值比较所有玩家的最好成绩\n";
                 cout << "\n训练建议:\n";
                 cout << "每天练习 15-20 分钟\n";
                 cout << "从 N=2 开始，逐渐增加难度\n";
                 cout << "保持专注，准确比速度更重要\n";
                 cout << "\n按任意键返回...";
-                cin.ignore();
-                cin.get();
+                waitAnyKey();
                 break;
             }
             default:
                 cout << "无效选择，请重新输入!\n";
-                cin.ignore();
-                cin.get();
+                cin.clear();
+                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                waitAnyKey();
                 break;
         }
     }
 }
 
-int main() {
-    srand(static_cast<unsigned>(time(nullptr)));
+// 批量模拟：模拟玩家在虚拟时钟上连续测试，用于验证计分、成就阈值和刺激序列统计
+void runSimulation(long long playerCount, int sessionsPerPlayer, int nValue, int trials,
+                   double hitRate, double falseAlarmRate, uint64_t seed) {
+    NBackEngine engine(nValue, trials);
+    engine.setSeed(seed);
+    SimulatedPlayer agent(hitRate, falseAlarmRate, 800, 300, engine.getStimulusDuration(),
+                          Xoshiro256::deriveSeed(seed, 1));
+    VirtualClock clock;
+    
+    AchievementSystem achSys;
+    achSys.setPersistent(false);
+    
+    long long unlockCounts[ACH_COUNT] = {0};
+    double accuracySum = 0;
+    long long visualMatchSum = 0, auditoryMatchSum = 0;
+    int minMatches = numeric_limits<int>::max(), maxMatches = 0;
+    long long sessionCount = 0;
+    
+    auto startTime = chrono::steady_clock::now();
+    for (long long p = 0; p < playerCount; p++) {
+        PlayerStats career;
+        career.name = "sim" + to_string(p);
+        
+        for (int k = 0; k < sessionsPerPlayer; k++) {
+            GameStats stats = engine.runHeadlessSession(career.name, agent, clock);
+            achSys.updatePlayerStats(career, stats);
+            achSys.checkAchievements(career, stats);
+            
+            int visualMatches = stats.visualHits + stats.visualMisses;
+            int auditoryMatches = stats.auditoryHits + stats.auditoryMisses;
+            visualMatchSum += visualMatches;
+            auditoryMatchSum += auditoryMatches;
+            minMatches = min(minMatches, min(visualMatches, auditoryMatches));
+            maxMatches = max(maxMatches, max(visualMatches, auditoryMatches));
+            accuracySum += stats.overallAccuracy;
+            sessionCount++;
+        }
+        
+        for (int i = 0; i < ACH_COUNT; i++) {
+            if (career.hasAchievement(i)) unlockCounts[i]++;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    
+    cout << "========================================\n";
+    cout << "         N-Back 批量模拟结果\n";
+    cout << "========================================\n";
+    cout << "N值: " << nValue << "  试次: " << trials
+         << "  命中率: " << hitRate << "  虚报率: " << falseAlarmRate << "\n";
+    cout << "模拟玩家: " << playerCount << "  每人测试: " << sessionsPerPlayer
+         << "  总测试: " << sessionCount << "\n";
+    if (sessionCount == 0) return;
+    
+    cout << fixed << setprecision(2);
+    cout << "平均总体准确率: " << accuracySum / sessionCount << "%\n";
+    cout << "每轮视觉匹配数: 平均 " << (double)visualMatchSum / sessionCount
+         << "  听觉匹配数: 平均 " << (double)auditoryMatchSum / sessionCount
+         << "  (范围 " << minMatches << "-" << maxMatches << ")\n";
+    cout << "\n成就解锁比例:\n";
+    for (int i = 0; i < ACH_COUNT; i++) {
+        cout << "  " << ACHIEVEMENT_NAMES[i] << ": "
+             << unlockCounts[i] * 100.0 / playerCount << "%\n";
+    }
+    cout << "\n耗时: " << setprecision(3) << seconds << " 秒, "
+         << setprecision(0) << (seconds > 0 ? sessionCount / seconds : 0) << " 轮/秒\n";
+}
+
+#ifndef NBACK_NO_MAIN
+// 按试次记录重新计分：行数与历史记录的试次数一致时才采用
+bool rescoreFromTrials(const vector<const TrialEventBlock*>& blocks, GameStats& stats) {
+    size_t rows = 0;
+    for (const TrialEventBlock* block : blocks) rows += block->rows();
+    if (rows == 0 || (int)rows != stats.totalTrials) return false;
+    
+    GameStats rescored;
+    rescored.playerName = stats.playerName;
+    rescored.nValue = stats.nValue;
+    for (const TrialEventBlock* block : blocks) {
+        for (size_t i = 0; i < block->rows(); i++) {
+            uint8_t f = block->flags[i];
+            TrialResponse response;
+            response.visual = (f & TRIAL_VISUAL_RESPONSE) != 0;
+            response.auditory = (f & TRIAL_AUDITORY_RESPONSE) != 0;
+            response.visualResponseTime = block->visualRt[i];
+            response.auditoryResponseTime = block->auditoryRt[i];
+            NBackEngine::updatePlayerStats(rescored, (f & TRIAL_VISUAL_MATCH) != 0,
+                                           (f & TRIAL_AUDITORY_MATCH) != 0, response);
+        }
+    }
+    stats = rescored;
+    return true;
+}
+
+// 已存的生涯局数多于回放结果的玩家：来自旧格式导入，或有历史记录之前的成绩。
+// replayed 按名字排序；覆盖这些玩家会丢掉较早的局数、成就和最好成绩
+vector<string> careersOlderThanHistory(const vector<PlayerStats>& replayed) {
+    PlayerStatsStore& store = PlayerStatsStore::instance();
+    map<string, int> storedTests;
+    PlayerStats stats;
+    size_t records = store.databaseRecords();
+    for (size_t slot = 0; slot < records; slot++) {
+        if (store.readSlot(slot, stats)) storedTests[stats.name] = stats.totalTests;
+    }
+    for (const PlayerStats& newer : store.journalPlayers()) storedTests[newer.name] = newer.totalTests;
+    
+    vector<string> older;
+    for (const auto& entry : storedTests) {
+        PlayerStats key;
+        key.name = entry.first;
+        auto it = lower_bound(replayed.begin(), replayed.end(), key, [](const PlayerStats& a, const PlayerStats& b) {
+            return a.name < b.name;
+        });
+        int replayedTests = (it != replayed.end() && it->name == entry.first) ? it->totalTests : 0;
+        if (entry.second > replayedTests) older.push_back(entry.first);
+    }
+    return older;
+}
+
+// 一个分片的回放结果
+struct ReplayShard {
+    AchievementSystem achievements;
+    LevelScores bests[BOARD_METRIC_COUNT];
+    long long sessions;
+    long long rescored;
+    
+    ReplayShard() : sessions(0), rescored(0) { achievements.setPersistent(false); }
+};
+
+// 回放全部历史成绩，重建每个玩家的生涯统计、成就和全球排行榜。
+// 按玩家名哈希分片，每个线程独占一组玩家并按时间顺序回放，结果按名字排序后合并，与线程数无关。
+// 有逐试次记录的局按试次重新计分，其余用历史记录里的计数；write 为 false 时只统计不写盘。
+// 已存的生涯里有历史记录覆盖不到的局时拒绝写盘
+void runHistoryReplay(unsigned threads, bool write) {
+    auto startTime = chrono::steady_clock::now();
+    HistoryStore& history = HistoryStore::instance();
+    uint32_t total = history.prepareScan() ? (uint32_t)history.size() : 0;
+    
+    vector<TrialEventBlock> blocks;
+    readTrialEventLog(TRIAL_LOG_FILE, blocks);
+    map<pair<uint64_t, string>, vector<const TrialEventBlock*>> trialsBySession;
+    for (const TrialEventBlock& block : blocks) {
+        trialsBySession[make_pair(block.sessionId, block.playerName)].push_back(&block);
+    }
+    for (auto& entry : trialsBySession) {
+        sort(entry.second.begin(), entry.second.end(), [](const TrialEventBlock* a, const TrialEventBlock* b) {
+            return a->firstTrial < b->firstTrial;
+        });
+    }
+    
+    // 分片内按 (名字哈希, 序号) 排序：同一玩家的局连在一起且仍按时间顺序，查找都落在热的节点上
+    vector<vector<pair<uint64_t, uint32_t>>> shardEntries(threads);
+    for (uint32_t i = 0; i < total; i++) {
+        uint64_t hash = history.playerHashAt(i);
+        shardEntries[hash % threads].push_back(make_pair(hash, i));
+    }
+    
+    vector<ReplayShard> shards(threads);
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.push_back(thread([&, t] {
+            ReplayShard& shard = shards[t];
+            sort(shardEntries[t].begin(), shardEntries[t].end());
+            for (const auto& entry : shardEntries[t]) {
+                history.scanRange(entry.second, entry.second + 1, [&](uint32_t, const HistoryRecord& record) {
+                    GameStats game = record.stats;
+                    auto trials = trialsBySession.find(make_pair(record.sessionId, game.playerName));
+                    if (trials != trialsBySession.end() && rescoreFromTrials(trials->second, game)) {
+                        shard.rescored++;
+                    }
+                    game.calculateAccuracies();
+                    
+                    PlayerStats* career = shard.achievements.getPlayerStats(game.playerName);
+                    shard.achievements.updatePlayerStats(*career, game);
+                    shard.achievements.checkAchievements(*career, game, record.playerCount > 1);
+                    shard.sessions++;
+                    
+                    map<string, double>& accuracy = shard.bests[BOARD_ACCURACY][game.nValue];
+                    auto best = accuracy.find(game.playerName);
+                    if (best == accuracy.end()) accuracy[game.playerName] = game.overallAccuracy;
+                    else best->second = max(best->second, game.overallAccuracy);
+                    if (game.responseCount() > 0) {
+                        map<string, double>& responseTime = shard.bests[BOARD_RESPONSE_TIME][game.nValue];
+                        best = responseTime.find(game.playerName);
+                        if (best == responseTime.end()) responseTime[game.playerName] = game.responseTimeAvg;
+                        else best->second = min(best->second, game.responseTimeAvg);
+                    }
+                });
+            }
+        }));
+    }
+    for (thread& worker : workers) worker.join();
+    
+    // 各分片的玩家互不相交，合并时按名字排序
+    vector<PlayerStats> players;
+    LevelScores bests[BOARD_METRIC_COUNT];
+    long long sessions = 0, rescored = 0;
+    for (ReplayShard& shard : shards) {
+        for (const auto& entry : shard.achievements.cachedPlayers()) players.push_back(entry.second);
+        for (int m = 0; m < BOARD_METRIC_COUNT; m++) {
+            for (auto& level : shard.bests[m]) bests[m][level.first].insert(level.second.begin(), level.second.end());
+        }
+        sessions += shard.sessions;
+        rescored += shard.rescored;
+        shard = ReplayShard();
+    }
+    sort(players.begin(), players.end(), [](const PlayerStats& a, const PlayerStats& b) {
+        return a.name < b.name;
+    });
+    double replaySeconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    
+    vector<string> older;
+    if (write) {
+        older = careersOlderThanHistory(players);
+        if (!older.empty()) write = false;
+    }
+    bool saved = true;
+    if (write) {
+        PlayerStatsStore& store = PlayerStatsStore::instance();
+        for (const PlayerStats& stats : players) store.put(stats);
+        store.flush();
+        saved = GlobalLeaderboard::instance().rebuild(bests);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    
+    long long unlocked[ACH_COUNT] = {0};
+    for (const PlayerStats& stats : players) {
+        for (int i = 0; i < ACH_COUNT; i++) unlocked[i] += stats.hasAchievement(i);
+    }
+    
+    cout << "========================================\n";
+    cout << "         N-Back 历史回放结果\n";
+    cout << "========================================\n";
+    cout << "历史成绩: " << sessions << " 局 (按试次重新计分 " << rescored << " 局)\n";
+    cout << "玩家: " << players.size() << "  线程: " << threads << "\n";
+    if (!players.empty()) {
+        cout << "\n成就解锁比例:\n";
+        cout << fixed << setprecision(2);
+        for (int i = 0; i < ACH_COUNT; i++) {
+            cout << "  " << ACHIEVEMENT_NAMES[i] << ": " << unlocked[i] * 100.0 / players.size() << "%\n";
+        }
+    }
+    if (!older.empty()) {
+        cout << "\n警告: " << older.size() << " 个玩家的生涯早于历史记录(如 " << older[0]
+             << ")，回放会丢掉较早的成绩，未写盘";
+    } else {
+        cout << "\n" << (write ? (saved ? "已写回玩家数据和全球排行榜" : "写回失败！") : "未写盘(--dry-run)");
+    }
+    cout << "\n耗时: " << fixed << setprecision(3) << replaySeconds << " 秒回放, "
+         << seconds << " 秒合计\n";
+}
+
+int main(int argc, char* argv[]) {
+    // 命令行模式: --simulate [玩家数] [每人测试数] [N值] [试次] [命中率] [虚报率] [种子]
+    if (argc > 1 && string(argv[1]) == "--simulate") {
+        long long playerCount = argc > 2 ? atoll(argv[2]) : 100000;
+        int sessionsPerPlayer = argc > 3 ? atoi(argv[3]) : 10;
+        int nValue = argc > 4 ? atoi(argv[4]) : 2;
+        int trials = argc > 5 ? atoi(argv[5]) : 20;
+        double hitRate = argc > 6 ? atof(argv[6]) : 0.8;
+        double falseAlarmRate = argc > 7 ? atof(argv[7]) : 0.1;
+        uint64_t seed = argc > 8 ? strtoull(argv[8], nullptr, 10) : 1;
+        runSimulation(playerCount, sessionsPerPlayer, nValue, trials, hitRate, falseAlarmRate, seed);
+        return 0;
+    }
+    
+    // 命令行模式: --replay-history [线程数] [--dry-run]
+    if (argc > 1 && string(argv[1]) == "--replay-history") {
+        // --dry-run 可以出现在任意位置；线程数必须是正整数，其它参数一律拒绝，以免误写盘
+        unsigned threads = thread::hardware_concurrency();
+        bool write = true;
+        bool threadsGiven = false;
+        for (int i = 2; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--dry-run") {
+                write = false;
+            } else if (!threadsGiven && !arg.empty() &&
+                       arg.find_first_not_of("0123456789") == string::npos && atoi(arg.c_str()) > 0) {
+                threads = (unsigned)atoi(arg.c_str());
+                threadsGiven = true;
+            } else {
+                cerr << "未知参数: " << arg << "\n";
+                cerr << "用法: " << argv[0] << " --replay-history [线程数] [--dry-run]\n";
+                return 1;
+            }
+        }
+        runHistoryReplay(max(threads, 1u), write);
+        return 0;
+    }
+    
+    // 命令行模式: --build-sequence-library [每组序列数] [最大N值] [种子]
+    if (argc > 1 && string(argv[1]) == "--build-sequence-library") {
+        uint32_t perEntry = argc > 2 ? (uint32_t)atoi(argv[2]) : 256;
+        int maxN = argc > 3 ? atoi(argv[3]) : 9;
+        uint64_t seed = argc > 4 ? strtoull(argv[4], nullptr, 10) : makeSessionSeed();
+        
+        vector<int> trialCounts;
+        for (int trials = 10; trials <= 60; trials += 5) {
+            trialCounts.push_back(trials);
+        }
+        
+        if (perEntry == 0 || !SequenceLibrary::build(SequenceLibrary::defaultPath(), maxN,
+                                                     trialCounts, perEntry, seed)) {
+            cout << "序列库生成失败！\n";
+            return 1;
+        }
+        cout << "序列库已生成: " << SequenceLibrary::defaultPath()
+             << " (N=1-" << maxN << ", 试次 10-60, 每组 " << perEntry << " 条)\n";
+        return 0;
+    }
     
 #ifdef _WIN32
     SetConsoleOutputCP(CP_UTF8);
+    // 屏幕渲染使用 ANSI 转义序列，需要开启虚拟终端处理
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD consoleMode = 0;
+    if (GetConsoleMode(hOut, &consoleMode)) {
+        SetConsoleMode(hOut, consoleMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
 #endif
     
     cout << "欢迎使用 N-Back 记忆训练系统 v3.0!\n";
     cout << "新增成就系统和远程联机功能！\n";
     cout << "按任意键继续...";
-    cin.get();
+    waitAnyKey();
     
     showMainMenu();
     
     return 0;
 }
+#endif // NBACK_NO_MAIN
@@ -0,0 +1,447 @@
+// nback-bench：核心热点路径的微基准，输出吞吐量和延迟百分位
+//
+// 编译: g++ -std=c++17 -O2 -pthread nback-bench.cpp -o nback-bench
+// 用法: nback-bench [--players 1000,100000,1000000] [--port 18888] [--label 版本] [--out nback_bench.jsonl]
+//
+// 与游戏共用同一份代码。每项测量分批计时，记录每批的平均单次耗时(纳秒)，
+// 百分位取自这些批次；耗时较长的操作每批 1 次，即逐次计时。
+// 人可读的结果打印到标准输出，同时以一行 JSON 追加到输出文件，便于在版本之间比较。
+// 测量在临时目录 nback_bench_data 下进行，结束后删除。
+#define NBACK_NO_MAIN
+#include "n-back.cpp"
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#define rmdir _rmdir
+inline int makeDirectory(const char* path) { return _mkdir(path); }
+#else
+inline int makeDirectory(const char* path) { return mkdir(path, 0755); }
+#endif
+
+// 防止被测代码被优化掉
+volatile uint64_t benchSink = 0;
+
+// 丢弃一切输出的流缓冲区
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+struct BenchResult {
+    string name;
+    string params;
+    size_t batch;
+    uint64_t operations;
+    double seconds;
+    LatencyHistogram nanos;  // 每批的平均单次耗时
+    
+    double throughput() const { return seconds > 0 ? operations / seconds : 0; }
+};
+
+class BenchRunner {
+private:
+    vector<BenchResult> results;
+
+public:
+    // 跑 batches 批、每批 batch 次 op()，op 返回值累加到 benchSink
+    template <typename Op>
+    BenchResult& measure(const string& name, const string& params, size_t batches, size_t batch, Op op) {
+        return measureBatches(name, params, batches, batch, [&] {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < batch; i++) sum += op();
+            return sum;
+        });
+    }
+    
+    // 同上，但 batchOp() 自己完成一整批(如一次发出一批消息再等全部收到)
+    template <typename BatchOp>
+    BenchResult& measureBatches(const string& name, const string& params, size_t batches, size_t batch,
+                                BatchOp batchOp) {
+        BenchResult result;
+        result.name = name;
+        result.params = params;
+        result.batch = batch;
+        result.operations = 0;
+        result.seconds = 0;
+        
+        uint64_t sink = 0;
+        for (size_t b = 0; b < batches; b++) {
+            auto start = chrono::steady_clock::now();
+            sink += batchOp();
+            auto elapsed = chrono::steady_clock::now() - start;
+            long long ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+            result.nanos.record((uint64_t)(ns / (long long)batch));
+            result.seconds += chrono::duration<double>(elapsed).count();
+            result.operations += batch;
+        }
+        benchSink += sink;
+        return add(result);
+    }
+    
+    BenchResult& add(const BenchResult& result) {
+        results.push_back(result);
+        const BenchResult& r = results.back();
+        cout << left << setw(30) << r.name << setw(18) << r.params << right
+             << setw(14) << fixed << setprecision(0) << r.throughput()
+             << setw(10) << r.nanos.valueAtPercentile(50) << setw(10) << r.nanos.valueAtPercentile(90)
+             << setw(10) << r.nanos.valueAtPercentile(99) << setw(12) << r.nanos.maximum() << "\n" << left;
+        return results.back();
+    }
+    
+    static void printHeader() {
+        cout << left << setw(30) << "benchmark" << setw(18) << "params" << right << setw(14) << "ops/s"
+             << setw(10) << "p50" << setw(10) << "p90" << setw(10) << "p99" << setw(12) << "max" << "  (ns)\n"
+             << left;
+    }
+    
+    // 全部结果作为一行 JSON 追加到文件
+    bool appendJsonLine(const string& path, const string& label) const {
+        ofstream out(path, ios::app);
+        if (!out) return false;
+#ifdef __VERSION__
+        const char* compiler = __VERSION__;
+#else
+        const char* compiler = "unknown";
+#endif
+        out << "{\"time\":" << (long long)time(nullptr) << ",\"label\":\"" << label
+            << "\",\"compiler\":\"" << compiler << "\",\"threads\":" << thread::hardware_concurrency()
+            << ",\"unit\":\"ns\",\"results\":[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            out << (i > 0 ? "," : "") << "{\"name\":\"" << r.name << "\",\"params\":\"" << r.params
+                << "\",\"batch\":" << r.batch << ",\"ops\":" << r.operations
+                << ",\"ops_per_sec\":" << fixed << setprecision(1) << r.throughput()
+                << ",\"mean\":" << (uint64_t)r.nanos.mean() << ",\"p50\":" << r.nanos.valueAtPercentile(50)
+                << ",\"p90\":" << r.nanos.valueAtPercentile(90) << ",\"p99\":" << r.nanos.valueAtPercentile(99)
+                << ",\"p999\":" << r.nanos.valueAtPercentile(99.9) << ",\"max\":" << r.nanos.maximum() << "}";
+        }
+        out << "]}\n";
+        return (bool)out;
+    }
+};
+
+// 暴露逐个生成刺激的过程：与 runTrial 一样，生成后记入刺激历史
+class BenchEngine : public NBackEngine {
+public:
+    BenchEngine(int nValue, int trials) : NBackEngine(nValue, trials) {}
+    
+    uint64_t generateSession() {
+        stimulusHistory.clear();
+        uint64_t sum = 0;
+        for (int i = 0; i < totalTrials; i++) {
+            stimulusHistory.push_back(generateStimulus(i));
+            sum += stimulusHistory.back().visualPosition;
+        }
+        return sum;
+    }
+    
+    uint64_t generatePredefined() {
+        generatePredefinedSequence();
+        return (uint64_t)generateStimulus(totalTrials - 1).visualPosition;
+    }
+};
+
+GameStats randomGameStats(Xoshiro256& rng, const string& name) {
+    GameStats stats;
+    stats.playerName = name;
+    stats.nValue = 1 + rng.bounded(6);
+    for (int i = 0; i < 30; i++) {
+        TrialResponse response;
+        bool visualMatch = rng.chance(0.3);
+        bool auditoryMatch = rng.chance(0.3);
+        response.visual = rng.chance(visualMatch ? 0.85 : 0.05);
+        response.auditory = rng.chance(auditoryMatch ? 0.85 : 0.05);
+        if (response.visual) response.visualResponseTime = 300 + rng.bounded(900);
+        if (response.auditory) response.auditoryResponseTime = 300 + rng.bounded(900);
+        NBackGame::updatePlayerStats(stats, visualMatch, auditoryMatch, response);
+    }
+    stats.calculateAccuracies();
+    return stats;
+}
+
+string benchPlayerName(size_t i) {
+    return "bench" + to_string(i);
+}
+
+void benchStimulus(BenchRunner& runner) {
+    for (int n : {2, 4}) {
+        BenchEngine engine(n, 40);
+        engine.setSeed(1);
+        runner.measureBatches("generate_stimulus", "n=" + to_string(n) + ",trials=40", 20000, 40,
+                              [&] { return engine.generateSession(); });
+        runner.measure("generate_predefined_sequence", "n=" + to_string(n) + ",trials=40", 20000, 1,
+                       [&] { return engine.generatePredefined(); });
+    }
+}
+
+void benchScoring(BenchRunner& runner) {
+    Xoshiro256 rng(2);
+    const size_t count = 4096;
+    vector<pair<bool, bool>> matches(count);
+    vector<TrialResponse> responses(count);
+    for (size_t i = 0; i < count; i++) {
+        matches[i] = make_pair(rng.chance(0.3), rng.chance(0.3));
+        responses[i].visual = rng.chance(0.4);
+        responses[i].auditory = rng.chance(0.4);
+        if (responses[i].visual) responses[i].visualResponseTime = 300 + rng.bounded(900);
+        if (responses[i].auditory) responses[i].auditoryResponseTime = 300 + rng.bounded(900);
+    }
+    
+    GameStats stats;
+    size_t next = 0;
+    runner.measure("update_player_stats", "", 2000, 1000, [&] {
+        size_t i = next++ & (count - 1);
+        NBackGame::updatePlayerStats(stats, matches[i].first, matches[i].second, responses[i]);
+        return (uint64_t)stats.visualHits;
+    });
+    runner.measure("calculate_accuracies", "", 2000, 1000, [&] {
+        stats.visualHits++;
+        stats.calculateAccuracies();
+        return (uint64_t)stats.overallAccuracy;
+    });
+}
+
+void benchAchievements(BenchRunner& runner) {
+    Xoshiro256 rng(3);
+    vector<GameStats> games;
+    for (int i = 0; i < 1024; i++) games.push_back(randomGameStats(rng, "bench"));
+    
+    AchievementSystem achievements;
+    achievements.setPersistent(false);
+    PlayerStats fresh;
+    fresh.name = "bench";
+    fresh.totalTests = 1;
+    PlayerStats career;
+    size_t next = 0;
+    runner.measure("check_achievements", "locked", 20000, 1, [&] {
+        career = fresh;
+        const GameStats& game = games[next++ & 1023];
+        return (uint64_t)achievements.checkAchievements(career, game, true).size();
+    });
+    career.achievements = ALL_ACHIEVEMENTS;
+    runner.measure("check_achievements", "all_unlocked", 2000, 1000, [&] {
+        const GameStats& game = games[next++ & 1023];
+        return (uint64_t)achievements.checkAchievements(career, game, true).size();
+    });
+}
+
+void benchLeaderboardSort(BenchRunner& runner) {
+    Xoshiro256 rng(4);
+    for (size_t players : {10, 1000}) {
+        vector<GameStats> all;
+        for (size_t i = 0; i < players; i++) all.push_back(randomGameStats(rng, benchPlayerName(i)));
+        runner.measure("leaderboard_sort", "players=" + to_string(players), players > 100 ? 500 : 20000, 1, [&] {
+            vector<GameStats> sorted = all;
+            sortByAccuracy(sorted);
+            return (uint64_t)sorted.front().overallAccuracy;
+        });
+    }
+}
+
+void benchDisplayGrid(BenchRunner& runner) {
+    NBackGame game(2, 40);
+    NullBuffer buffer;
+    ostream sink(&buffer);
+    Stimulus stim;
+    int next = 0;
+    runner.measure("display_grid", "null_sink", 2000, 100, [&] {
+        stim.visualPosition = next++ % 9;
+        game.displayGrid(sink, stim, "bench");
+        return (uint64_t)stim.visualPosition;
+    });
+}
+
+// 在 players 个玩家的存储上测量读写，存储放在当前目录下的 players_N 子目录里
+void benchPlayerStore(BenchRunner& runner, size_t players) {
+    string dir = "players_" + to_string(players);
+    string params = "players=" + to_string(players);
+    if (makeDirectory(dir.c_str()) != 0 && errno != EEXIST) return;
+    if (chdir(dir.c_str()) != 0) return;
+    
+    PlayerStatsStore& store = PlayerStatsStore::instance();
+    store.close();
+    {
+        Xoshiro256 rng(5);
+        vector<PlayerStats> all(players);
+        for (size_t i = 0; i < players; i++) {
+            all[i].name = benchPlayerName(i);
+            all[i].totalTests = 1 + rng.bounded(50);
+            all[i].totalTrials = all[i].totalTests * 30;
+            all[i].maxNLevel = 1 + rng.bounded(6);
+            all[i].bestAccuracy = 50 + rng.bounded(50);
+            all[i].bestResponseTime = 400 + rng.bounded(800);
+            all[i].achievements = (AchievementMask)rng.bounded(ALL_ACHIEVEMENTS + 1);
+        }
+        PlayerStatsStore::importDatabase(all);
+    }
+    
+    AchievementSystem achievements;
+    runner.measure("load_player_stats", params, 50, 1, [&] {
+        store.close();
+        achievements.loadPlayerStats();
+        return (uint64_t)store.databaseRecords();
+    });
+    
+    Xoshiro256 rng(6);
+    runner.measure("get_player_stats", params, 20000, 1, [&] {
+        return (uint64_t)achievements.getPlayerStats(benchPlayerName(rng.bounded((uint32_t)players)))->totalTests;
+    });
+    
+    vector<PlayerStats> updates;
+    for (int i = 0; i < 20000; i++) {
+        PlayerStats stats;
+        stats.name = benchPlayerName(rng.bounded((uint32_t)players));
+        stats.totalTests = i;
+        stats.recentAccuracies.assign(RECENT_ACCURACY_COUNT, 80.0);
+        updates.push_back(stats);
+    }
+    size_t next = 0;
+    runner.measure("save_player_stats", params, updates.size(), 1, [&] {
+        achievements.savePlayerStats(updates[next++]);
+        return (uint64_t)next;
+    });
+    runner.measure("save_player_stats_flush", params, 1, 1, [&] {
+        store.flush();
+        return (uint64_t)0;
+    });
+    
+    store.close();
+    remove(PLAYER_DB_FILE);
+    remove(PLAYER_JOURNAL_FILE);
+    if (chdir("..") == 0) rmdir(dir.c_str());
+}
+
+// 回环上的一对主机和客户端，同一线程里轮流驱动
+class LoopbackPair {
+private:
+    struct Endpoint : public NetworkListener {
+        long long received;
+        int lastClient;
+        
+        Endpoint() : received(0), lastClient(-1) {}
+        void onClientConnected(int clientId) override { lastClient = clientId; }
+        void onMessage(int clientId, const WireMessage&) override {
+            received++;
+            lastClient = clientId;
+        }
+    };
+
+public:
+    NetworkManager host;
+    NetworkManager client;
+    Endpoint hostSide;
+    Endpoint clientSide;
+    
+    bool open(int port) {
+        host.setListener(&hostSide);
+        client.setListener(&clientSide);
+        if (!host.startServer(port) || !client.connectToServer("127.0.0.1", port)) return false;
+        for (int i = 0; i < 1000 && hostSide.lastClient < 0; i++) host.service(1);
+        return hostSide.lastClient >= 0;
+    }
+    
+    // 两端轮流处理，直到 done() 成立
+    template <typename Done>
+    bool pump(Done done) {
+        for (int spins = 0; spins < 1000000; spins++) {
+            if (done()) return true;
+            client.service(0);
+            host.service(0);
+        }
+        return done();
+    }
+};
+
+void benchNetwork(BenchRunner& runner, int port) {
+    LoopbackPair pair;
+    if (!pair.open(port)) {
+        cout << "回环连接失败，跳过网络测量(端口 " << port << ")\n";
+        return;
+    }
+    
+    ResponseMessage response;
+    response.trialIndex = 1;
+    response.response.visual = true;
+    response.response.visualResponseTime = 512;
+    StimulusMessage stimulus;
+    stimulus.trialIndex = 1;
+    stimulus.stimulus.visualPosition = 4;
+    stimulus.stimulus.auditoryLetter = 'K';
+    stimulus.durationMs = 2000;
+    
+    // 往返：客户端发响应，主机收到后回一个刺激
+    runner.measure("network_round_trip", "loopback", 20000, 1, [&] {
+        long long hostTarget = pair.hostSide.received + 1;
+        long long clientTarget = pair.clientSide.received + 1;
+        pair.client.send(response);
+        pair.pump([&] { return pair.hostSide.received >= hostTarget; });
+        pair.host.sendTo(pair.hostSide.lastClient, stimulus);
+        pair.pump([&] { return pair.clientSide.received >= clientTarget; });
+        return (uint64_t)pair.clientSide.received;
+    });
+    
+    // 单向吞吐：客户端连发一批，主机全部收完为止
+    runner.measureBatches("network_send_receive", "loopback,burst=1000", 200, 1000, [&] {
+        long long target = pair.hostSide.received + 1000;
+        for (int i = 0; i < 1000; i++) pair.client.send(response);
+        pair.pump([&] { return pair.hostSide.received >= target; });
+        return (uint64_t)pair.hostSide.received;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    vector<size_t> playerCounts = {1000, 100000, 1000000};
+    int port = 18888;
+    string label = "dev";
+    string outPath = "nback_bench.jsonl";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--players") {
+            playerCounts.clear();
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ',')) {
+                if (atoll(item.c_str()) > 0) playerCounts.push_back((size_t)atoll(item.c_str()));
+            }
+        } else if (option == "--port") {
+            port = atoi(value.c_str());
+        } else if (option == "--label") {
+            label = value;
+        } else if (option == "--out") {
+            outPath = value;
+        } else {
+            cerr << "未知参数: " << option << "\n";
+            return 1;
+        }
+    }
+    const char* dataDir = "nback_bench_data";
+    if ((makeDirectory(dataDir) != 0 && errno != EEXIST) || chdir(dataDir) != 0) {
+        cerr << "无法创建临时目录 " << dataDir << "\n";
+        return 1;
+    }
+    
+    BenchRunner runner;
+    BenchRunner::printHeader();
+    benchStimulus(runner);
+    benchScoring(runner);
+    benchAchievements(runner);
+    benchLeaderboardSort(runner);
+    benchDisplayGrid(runner);
+    for (size_t players : playerCounts) benchPlayerStore(runner, players);
+    benchNetwork(runner, port);
+    
+    PlayerStatsStore::instance().close();
+    remove(PLAYER_DB_FILE);
+    remove(PLAYER_JOURNAL_FILE);
+    if (chdir("..") == 0) rmdir(dataDir);
+    
+    if (!runner.appendJsonLine(outPath, label)) {
+        cerr << "写入结果失败: " << outPath << "\n";
+        return 1;
+    }
+    cout << "结果已追加到 " << outPath << "\n";
+    return 0;
+}
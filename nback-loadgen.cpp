@@ -0,0 +1,455 @@
+// nback-loadgen：回环负载测试，模拟许多远程客户端同时参加一局联机对局
+//
+// 编译: g++ -std=c++17 -O2 -pthread nback-loadgen.cpp -o nback-loadgen
+// 用法: nback-loadgen [--clients 10,100,500] [--port 18890] [--n 2] [--trials 20]
+//                     [--stimulus-ms 2000] [--isi-ms 500] [--label 版本] [--out nback_loadgen.jsonl]
+//
+// 与游戏共用同一份代码。每个客户端数跑一局：主机是同一进程里无人值守的 NBackGame，
+// 在独立线程里监听回环端口；模拟客户端全部由主线程里的一个 NetworkManager 驱动，
+// 按游戏协议报名、接收设置和刺激，像真实客户端一样在刺激窗口结束时发回响应
+// (按键由模拟玩家决定，反应时间随机)，再接收判分和排行榜。每局报告：
+//   连接建立    每条连接 connect() 的耗时和全部连上的总耗时
+//   刺激送达    客户端收到刺激的时刻减去主机的计划出现时刻
+//   判分送达    客户端收到判分的时刻减去主机计划关闭试次的时刻
+//   吞吐量      对局期间客户端收发的消息数/秒
+//   主机 CPU    主机线程的 CPU 时间，按客户端平均
+// 延迟都以主机的计划时刻为基准，包含主机线程唤醒晚点和逐个发送的排队时间。
+// 刺激送达加上响应回传超过半个刺激间隔时，主机会把响应判为未作答，报告里记为超时响应。
+// 结果一局一行追加到输出文件(JSON)。测量在临时目录 nback_loadgen_data 下进行，结束后删除。
+#define NBACK_NO_MAIN
+#include "n-back.cpp"
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#define rmdir _rmdir
+inline int makeDirectory(const char* path) { return _mkdir(path); }
+#else
+#include <sys/resource.h>
+inline int makeDirectory(const char* path) { return mkdir(path, 0755); }
+#endif
+
+// 丢弃一切输出的流缓冲区
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+// 当前线程已用的 CPU 时间(秒)
+double threadCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+    auto seconds = [](const FILETIME& t) {
+        return (double)(((uint64_t)t.dwHighDateTime << 32) | t.dwLowDateTime) * 1e-7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// 每个客户端在本进程里占两个文件描述符(两端各一个)，把软上限调到硬上限
+void raiseDescriptorLimit() {
+#ifndef _WIN32
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+struct LoadOptions {
+    int n;
+    int trials;
+    int stimulusMs;
+    int isiMs;
+    int port;
+    
+    LoadOptions() : n(2), trials(20), stimulusMs(2000), isiMs(500), port(18890) {}
+};
+
+// 一个模拟客户端
+struct LoadClient {
+    int connectionId;
+    int n;
+    bool leaderboardReceived;
+    SimulatedPlayer player;
+    vector<Stimulus> history;
+    vector<chrono::steady_clock::time_point> stimulusArrivals;  // 按试次，未收到为默认值
+    vector<chrono::steady_clock::time_point> scoreArrivals;
+    vector<char> pressed;
+    
+    LoadClient() : connectionId(-1), n(0), leaderboardReceived(false), player(0.8, 0.1) {}
+};
+
+// 等到刺激窗口结束才发出的响应
+struct PendingResponse {
+    chrono::steady_clock::time_point due;
+    int client;
+    ResponseMessage reply;
+};
+
+// 同一个 NetworkManager 上的所有模拟客户端，在一个线程里驱动
+class LoadClients : public NetworkListener {
+private:
+    NetworkManager network;
+    vector<LoadClient> clients;
+    map<int, int> clientByConnection;
+    deque<PendingResponse> pending;  // 窗口时长相同，按收到刺激的顺序即按发送时刻排序
+    int trials;
+    uint64_t seed;
+    
+public:
+    long long messagesReceived;
+    long long messagesSent;
+    long long lateResponses;   // 发出了按键、判分里却是未作答
+    long long pressedResponses;
+    chrono::steady_clock::time_point firstMessage;
+    chrono::steady_clock::time_point lastMessage;
+    
+    LoadClients(int trialCount, uint64_t baseSeed)
+        : trials(trialCount), seed(baseSeed), messagesReceived(0), messagesSent(0),
+          lateResponses(0), pressedResponses(0) {
+        network.setListener(this);
+    }
+    
+    // 逐个建立连接并报名，每条连接的 connect() 耗时记入 connectMicros，返回连上的数量
+    int connect(const string& ip, int port, int count, LatencyHistogram& connectMicros) {
+        clients.reserve(count);
+        for (int i = 0; i < count; i++) {
+            auto started = chrono::steady_clock::now();
+            int id = network.openConnection(ip, port);
+            if (id < 0) break;
+            connectMicros.record((uint64_t)chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - started).count());
+            
+            clientByConnection[id] = (int)clients.size();
+            clients.push_back(LoadClient());
+            LoadClient& client = clients.back();
+            client.connectionId = id;
+            client.stimulusArrivals.assign(trials, chrono::steady_clock::time_point());
+            client.scoreArrivals.assign(trials, chrono::steady_clock::time_point());
+            client.pressed.assign(trials, 0);
+            
+            JoinMessage join;
+            stringstream name;
+            name << "load_" << setw(4) << setfill('0') << i;
+            join.playerName = name.str();
+            if (network.sendTo(id, join)) messagesSent++;
+        }
+        return (int)clients.size();
+    }
+    
+    // 驱动所有客户端，直到都收完排行榜断开、主机断开或超过 deadline
+    void run(chrono::steady_clock::time_point deadline) {
+        while (network.isReady()) {
+            auto now = chrono::steady_clock::now();
+            while (!pending.empty() && pending.front().due <= now) {
+                const PendingResponse& next = pending.front();
+                if (network.sendTo(clients[next.client].connectionId, next.reply)) messagesSent++;
+                pending.pop_front();
+            }
+            if (now >= deadline) break;
+            
+            auto wake = pending.empty() ? deadline : min(deadline, pending.front().due);
+            long long waitMs = chrono::duration_cast<chrono::milliseconds>(wake - now).count();
+            network.service((int)max(0LL, waitMs));
+        }
+    }
+    
+    const vector<LoadClient>& all() const { return clients; }
+    
+    int leaderboards() const {
+        int received = 0;
+        for (const LoadClient& client : clients) received += client.leaderboardReceived ? 1 : 0;
+        return received;
+    }
+    
+    void onClientConnected(int) override {}
+    void onClientDisconnected(int) override {}
+    
+    void onMessage(int connectionId, const WireMessage& msg) override {
+        auto it = clientByConnection.find(connectionId);
+        if (it == clientByConnection.end()) return;
+        int index = it->second;
+        LoadClient& client = clients[index];
+        auto now = chrono::steady_clock::now();
+        if (messagesReceived++ == 0) firstMessage = now;
+        lastMessage = now;
+        
+        switch (msg.type) {
+        case MSG_SETTINGS: {
+            SettingsMessage settings;
+            if (!msg.decode(settings)) break;
+            client.n = settings.n;
+            client.player = SimulatedPlayer(0.8, 0.1, 600, 250, settings.stimulusDuration,
+                                            Xoshiro256::deriveSeed(seed, (uint64_t)index));
+            break;
+        }
+        case MSG_STIMULUS: {
+            // 客户端自己记下刺激序列来判断匹配，模拟玩家据此作答
+            StimulusMessage stim;
+            if (!msg.decode(stim) || stim.trialIndex >= trials) break;
+            client.stimulusArrivals[stim.trialIndex] = now;
+            client.history.push_back(stim.stimulus);
+            size_t count = client.history.size();
+            bool visualMatch = false;
+            bool auditoryMatch = false;
+            if (client.n > 0 && (int)count > client.n) {
+                const Stimulus& nBack = client.history[count - 1 - client.n];
+                visualMatch = stim.stimulus.visualPosition == nBack.visualPosition;
+                auditoryMatch = stim.stimulus.auditoryLetter == nBack.auditoryLetter;
+            }
+            
+            PendingResponse response;
+            response.due = now + chrono::milliseconds(stim.durationMs);
+            response.client = index;
+            response.reply.trialIndex = stim.trialIndex;
+            response.reply.response = client.player.respond(stim.stimulus, stim.trialIndex,
+                                                            visualMatch, auditoryMatch);
+            if (response.reply.response.visual || response.reply.response.auditory) {
+                client.pressed[stim.trialIndex] = 1;
+                pressedResponses++;
+            }
+            pending.push_back(response);
+            break;
+        }
+        case MSG_SCORE: {
+            ScoreMessage score;
+            if (!msg.decode(score) || score.trialIndex >= trials) break;
+            client.scoreArrivals[score.trialIndex] = now;
+            if (client.pressed[score.trialIndex] && !score.response.visual && !score.response.auditory) {
+                lateResponses++;
+            }
+            break;
+        }
+        case MSG_LEADERBOARD:
+            // 收完排行榜即退出房间，和真实客户端一样
+            client.leaderboardReceived = true;
+            network.dropClient(connectionId);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+// 一局的测量结果
+struct LoadResult {
+    int clients;
+    int connected;
+    int scored;         // 主机给出成绩的远程玩家数
+    int leaderboards;
+    double connectAllMs;
+    LatencyHistogram connectMicros;
+    LatencyHistogram stimulusMicros;
+    LatencyHistogram scoreMicros;
+    LatencyHistogram onsetErrorMicros;
+    long long messages;
+    double messageSeconds;
+    long long pressedResponses;
+    long long lateResponses;
+    double hostCpuSeconds;
+    double clientCpuSeconds;
+    double sessionSeconds;
+    
+    LoadResult() : clients(0), connected(0), scored(0), leaderboards(0), connectAllMs(0), messages(0),
+                   messageSeconds(0), pressedResponses(0), lateResponses(0), hostCpuSeconds(0),
+                   clientCpuSeconds(0), sessionSeconds(0) {}
+    
+    double messagesPerSecond() const { return messageSeconds > 0 ? messages / messageSeconds : 0; }
+    double hostCpuPerClientMs() const { return connected > 0 ? hostCpuSeconds * 1000 / connected : 0; }
+};
+
+// 从计划时刻到实际时刻的微秒数，早于计划的记为 0
+uint64_t microsSince(chrono::steady_clock::time_point planned, chrono::steady_clock::time_point actual) {
+    long long us = chrono::duration_cast<chrono::microseconds>(actual - planned).count();
+    return us > 0 ? (uint64_t)us : 0;
+}
+
+// 在回环上跑一局：主机线程 + 主线程里的 clientCount 个模拟客户端
+bool runLoad(int clientCount, const LoadOptions& options, LoadResult& result) {
+    result.clients = clientCount;
+    NBackGame host(options.n, options.trials, options.stimulusMs, options.isiMs);
+    
+    // 启动提示不混进报告
+    NullBuffer nullBuffer;
+    streambuf* saved = cout.rdbuf(&nullBuffer);
+    bool listening = host.startRemoteServer(options.port);
+    cout.rdbuf(saved);
+    if (!listening) return false;
+    
+    // 报名最多等到每 100 个客户端 1 秒，至少 5 秒
+    int joinTimeoutMs = max(5000, clientCount * 10);
+    vector<GameStats> scored;
+    thread hostThread([&] {
+        double cpuBefore = threadCpuSeconds();
+        scored = host.runHeadlessHost(clientCount, joinTimeoutMs);
+        result.hostCpuSeconds = threadCpuSeconds() - cpuBefore;
+    });
+    
+    LoadClients simulated(options.trials, makeSessionSeed());
+    double cpuBefore = threadCpuSeconds();
+    auto started = chrono::steady_clock::now();
+    result.connected = simulated.connect("127.0.0.1", options.port, clientCount, result.connectMicros);
+    result.connectAllMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+    
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(joinTimeoutMs + NETWORK_START_DELAY_MS) +
+        chrono::milliseconds((long long)options.trials * (options.stimulusMs + options.isiMs) + 5000);
+    simulated.run(deadline);
+    result.clientCpuSeconds = threadCpuSeconds() - cpuBefore;
+    hostThread.join();
+    result.sessionSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    
+    // 主机线程结束后再读它的计划时刻，和客户端的到达时刻对照
+    chrono::milliseconds closeDelay(options.stimulusMs + options.isiMs / 2);
+    for (const LoadClient& client : simulated.all()) {
+        for (int i = 0; i < options.trials; i++) {
+            if (client.stimulusArrivals[i] != chrono::steady_clock::time_point()) {
+                result.stimulusMicros.record(microsSince(host.plannedOnset(i), client.stimulusArrivals[i]));
+            }
+            if (client.scoreArrivals[i] != chrono::steady_clock::time_point()) {
+                result.scoreMicros.record(microsSince(host.plannedOnset(i) + closeDelay, client.scoreArrivals[i]));
+            }
+        }
+    }
+    for (long long error : host.onsetErrors()) result.onsetErrorMicros.record(error > 0 ? (uint64_t)error : 0);
+    
+    result.scored = (int)scored.size();
+    result.leaderboards = simulated.leaderboards();
+    result.messages = simulated.messagesReceived + simulated.messagesSent;
+    result.messageSeconds = chrono::duration<double>(simulated.lastMessage - simulated.firstMessage).count();
+    result.pressedResponses = simulated.pressedResponses;
+    result.lateResponses = simulated.lateResponses;
+    return true;
+}
+
+void printPercentiles(ostream& out, const char* title, const LatencyHistogram& h) {
+    out << "  " << left << setw(22) << title << right << setw(9) << h.count()
+        << setw(10) << h.valueAtPercentile(50) << setw(10) << h.valueAtPercentile(90)
+        << setw(10) << h.valueAtPercentile(99) << setw(10) << h.maximum() << "\n";
+}
+
+void printResult(ostream& out, const LoadResult& r) {
+    out << "\n=== " << r.clients << " 个客户端 ===\n";
+    out << "连接: " << r.connected << "/" << r.clients << "，全部连上用时 " << fixed << setprecision(1)
+        << r.connectAllMs << " ms；主机计分 " << r.scored << " 人，收到排行榜 " << r.leaderboards << " 人\n";
+    out << "  " << left << setw(22) << "(us)" << right << setw(9) << "count" << setw(10) << "p50"
+        << setw(10) << "p90" << setw(10) << "p99" << setw(10) << "max" << "\n";
+    printPercentiles(out, "connect", r.connectMicros);
+    printPercentiles(out, "stimulus_delivery", r.stimulusMicros);
+    printPercentiles(out, "score_delivery", r.scoreMicros);
+    printPercentiles(out, "host_onset_lateness", r.onsetErrorMicros);
+    out << left << setprecision(0);
+    out << "吞吐量: " << r.messages << " 条消息，" << r.messagesPerSecond() << " 条/秒\n";
+    out << setprecision(3) << "主机 CPU: " << r.hostCpuSeconds << " 秒，每客户端 " << r.hostCpuPerClientMs()
+        << " ms；模拟客户端 CPU: " << r.clientCpuSeconds << " 秒\n";
+    out << "超时响应: " << r.lateResponses << "/" << r.pressedResponses << " 次按键\n";
+}
+
+void writeHistogramJson(ostream& out, const char* name, const LatencyHistogram& h) {
+    out << ",\"" << name << "\":{\"count\":" << h.count() << ",\"mean\":" << (uint64_t)h.mean()
+        << ",\"p50\":" << h.valueAtPercentile(50) << ",\"p90\":" << h.valueAtPercentile(90)
+        << ",\"p99\":" << h.valueAtPercentile(99) << ",\"max\":" << h.maximum() << "}";
+}
+
+bool appendJsonLine(const string& path, const string& label, const LoadOptions& options, const LoadResult& r) {
+    ofstream out(path, ios::app);
+    if (!out) return false;
+    out << "{\"time\":" << (long long)time(nullptr) << ",\"label\":\"" << label << "\",\"unit\":\"us\""
+        << ",\"clients\":" << r.clients << ",\"connected\":" << r.connected << ",\"scored\":" << r.scored
+        << ",\"leaderboards\":" << r.leaderboards << ",\"n\":" << options.n << ",\"trials\":" << options.trials
+        << ",\"stimulus_ms\":" << options.stimulusMs << ",\"isi_ms\":" << options.isiMs
+        << fixed << setprecision(3) << ",\"connect_all_ms\":" << r.connectAllMs;
+    writeHistogramJson(out, "connect", r.connectMicros);
+    writeHistogramJson(out, "stimulus_delivery", r.stimulusMicros);
+    writeHistogramJson(out, "score_delivery", r.scoreMicros);
+    writeHistogramJson(out, "host_onset_lateness", r.onsetErrorMicros);
+    out << ",\"messages\":" << r.messages << ",\"messages_per_sec\":" << r.messagesPerSecond()
+        << ",\"host_cpu_s\":" << r.hostCpuSeconds << ",\"host_cpu_per_client_ms\":" << r.hostCpuPerClientMs()
+        << ",\"client_cpu_s\":" << r.clientCpuSeconds << ",\"session_s\":" << r.sessionSeconds
+        << ",\"pressed_responses\":" << r.pressedResponses << ",\"late_responses\":" << r.lateResponses << "}\n";
+    return (bool)out;
+}
+
+int main(int argc, char* argv[]) {
+    vector<int> clientCounts = {10, 100, 500};
+    LoadOptions options;
+    string label = "dev";
+    string outPath = "nback_loadgen.jsonl";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        string value = argv[i + 1];
+        if (option == "--clients") {
+            clientCounts.clear();
+            stringstream list(value);
+            string item;
+            while (getline(list, item, ',')) {
+                if (atoi(item.c_str()) > 0) clientCounts.push_back(atoi(item.c_str()));
+            }
+        } else if (option == "--port") {
+            options.port = atoi(value.c_str());
+        } else if (option == "--n") {
+            options.n = max(1, atoi(value.c_str()));
+        } else if (option == "--trials") {
+            options.trials = max(1, atoi(value.c_str()));
+        } else if (option == "--stimulus-ms") {
+            options.stimulusMs = max(200, atoi(value.c_str()));
+        } else if (option == "--isi-ms") {
+            options.isiMs = max(0, atoi(value.c_str()));
+        } else if (option == "--label") {
+            label = value;
+        } else if (option == "--out") {
+            outPath = value;
+        } else {
+            cerr << "未知参数: " << option << "\n";
+            return 1;
+        }
+    }
+    raiseDescriptorLimit();
+    
+    // 输出文件的相对路径按启动目录解析
+    ofstream probe(outPath, ios::app);
+    if (!probe) {
+        cerr << "无法写入结果文件: " << outPath << "\n";
+        return 1;
+    }
+    probe.close();
+    const char* dataDir = "nback_loadgen_data";
+    if ((makeDirectory(dataDir) != 0 && errno != EEXIST) || chdir(dataDir) != 0) {
+        cerr << "无法创建临时目录 " << dataDir << "\n";
+        return 1;
+    }
+    
+    cout << "回环负载测试: N=" << options.n << " 试次 " << options.trials << " 刺激 " << options.stimulusMs
+         << " ms 间隔 " << options.isiMs << " ms 端口 " << options.port << "\n";
+    vector<LoadResult> results;
+    for (int clients : clientCounts) {
+        results.push_back(LoadResult());
+        if (!runLoad(clients, options, results.back())) {
+            cerr << "无法在端口 " << options.port << " 上启动主机\n";
+            results.pop_back();
+            break;
+        }
+        printResult(cout, results.back());
+    }
+    
+    PlayerStatsStore::instance().close();
+    remove(PLAYER_DB_FILE);
+    remove(PLAYER_JOURNAL_FILE);
+    if (chdir("..") == 0) rmdir(dataDir);
+    
+    for (const LoadResult& result : results) {
+        if (!appendJsonLine(outPath, label, options, result)) {
+            cerr << "写入结果失败: " << outPath << "\n";
+            return 1;
+        }
+    }
+    cout << "\n结果已追加到 " << outPath << "\n";
+    return 0;
+}
@@ -0,0 +1,243 @@
+// nback-report：离线统计报表，把历史成绩和玩家数据汇总成 CSV
+//
+// 编译: g++ -std=c++17 -O2 -pthread nback-report.cpp -o nback-report
+// 用法: nback-report [输出文件前缀] [线程数]
+//
+// 与游戏共用同一份存储和计分代码：历史记录和玩家数据库都是内存映射后按段分给各线程扫描，
+// 每个线程只累加自己的局部结果，最后在主线程合并。输出：
+//   <前缀>progress.csv      每个玩家逐局的进步曲线
+//   <前缀>n_levels.csv      各 N 值的局数和人数分布
+//   <前缀>accuracy_by_n.csv 各 N 值的准确率、d′ 和反应时间
+//   <前缀>achievements.csv  各成就的解锁率
+#define NBACK_NO_MAIN
+#include "n-back.cpp"
+
+#include <set>
+
+// CSV 字段：含逗号、引号或换行时加引号转义
+string csvField(const string& value) {
+    if (value.find_first_of(",\"\r\n") == string::npos) return value;
+    string quoted = "\"";
+    for (char c : value) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// 一个 N 值的汇总
+struct LevelSummary {
+    long long sessions;
+    double accuracySum;
+    double accuracySquares;
+    double responseTimeSum;
+    long long responseTimeSessions;
+    SignalDetection visual;
+    SignalDetection auditory;
+    set<uint64_t> players;
+    
+    LevelSummary() : sessions(0), accuracySum(0), accuracySquares(0),
+                     responseTimeSum(0), responseTimeSessions(0) {}
+    
+    void add(const GameStats& stats) {
+        sessions++;
+        accuracySum += stats.overallAccuracy;
+        accuracySquares += stats.overallAccuracy * stats.overallAccuracy;
+        if (stats.responseCount() > 0) {
+            responseTimeSum += stats.responseTimeAvg;
+            responseTimeSessions++;
+        }
+        visual += SignalDetection::visualOf(stats);
+        auditory += SignalDetection::auditoryOf(stats);
+        players.insert(fnv1a64(stats.playerName.data(), stats.playerName.size()));
+    }
+    
+    void merge(const LevelSummary& other) {
+        sessions += other.sessions;
+        accuracySum += other.accuracySum;
+        accuracySquares += other.accuracySquares;
+        responseTimeSum += other.responseTimeSum;
+        responseTimeSessions += other.responseTimeSessions;
+        visual += other.visual;
+        auditory += other.auditory;
+        players.insert(other.players.begin(), other.players.end());
+    }
+};
+
+// 进步曲线的一行，entry 为历史索引序号(即时间顺序)
+struct ProgressRow {
+    uint32_t entry;
+    int64_t timestamp;
+    GameStats stats;
+};
+
+// 每个线程的局部结果
+struct HistoryPartial {
+    map<int, LevelSummary> levels;
+    vector<ProgressRow> progress;
+};
+
+// 每个线程的成就解锁计数
+struct AchievementPartial {
+    long long players;
+    long long unlocked[ACH_COUNT];
+    
+    AchievementPartial() : players(0) { fill(unlocked, unlocked + ACH_COUNT, 0); }
+    
+    void add(const PlayerStats& stats) {
+        players++;
+        for (int i = 0; i < ACH_COUNT; i++) unlocked[i] += stats.hasAchievement(i);
+    }
+    
+    void merge(const AchievementPartial& other) {
+        players += other.players;
+        for (int i = 0; i < ACH_COUNT; i++) unlocked[i] += other.unlocked[i];
+    }
+};
+
+// 把 [0, total) 平均分成 parts 段，对每段在一个线程里调用 work(段号, 起点, 终点)
+template <typename Work>
+void runPartitioned(size_t total, unsigned parts, Work work) {
+    vector<thread> workers;
+    for (unsigned p = 0; p < parts; p++) {
+        size_t begin = total * p / parts;
+        size_t end = total * (p + 1) / parts;
+        workers.push_back(thread(work, p, begin, end));
+    }
+    for (thread& worker : workers) worker.join();
+}
+
+bool writeProgress(const string& path, vector<ProgressRow>& rows) {
+    ofstream out(path);
+    if (!out) return false;
+    // 各段按时间顺序依次拼接，按名字稳定排序后每个玩家的局仍是时间顺序
+    stable_sort(rows.begin(), rows.end(), [](const ProgressRow& a, const ProgressRow& b) {
+        return a.stats.playerName < b.stats.playerName;
+    });
+    out << "player,session,timestamp,n,trials,overall_accuracy,visual_accuracy,auditory_accuracy,"
+           "visual_dprime,auditory_dprime,response_time_ms\n";
+    int session = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+        const GameStats& s = rows[i].stats;
+        session = (i > 0 && rows[i - 1].stats.playerName == s.playerName) ? session + 1 : 1;
+        out << csvField(s.playerName) << "," << session << "," << rows[i].timestamp << "," << s.nValue << ","
+            << s.totalTrials << fixed << setprecision(2) << "," << s.overallAccuracy << ","
+            << s.visualAccuracy << "," << s.auditoryAccuracy << ","
+            << setprecision(3) << SignalDetection::visualOf(s).dPrime() << ","
+            << SignalDetection::auditoryOf(s).dPrime() << "," << setprecision(1);
+        if (s.responseCount() > 0) out << s.responseTimeAvg;
+        out << "\n";
+    }
+    return (bool)out;
+}
+
+bool writeLevels(const string& distributionPath, const string& accuracyPath,
+                 const map<int, LevelSummary>& levels) {
+    ofstream distribution(distributionPath);
+    ofstream accuracy(accuracyPath);
+    if (!distribution || !accuracy) return false;
+    
+    long long totalSessions = 0;
+    for (const auto& level : levels) totalSessions += level.second.sessions;
+    
+    distribution << "n,sessions,session_share,players\n";
+    accuracy << "n,sessions,mean_accuracy,sd_accuracy,visual_hit_rate,visual_false_alarm_rate,visual_dprime,"
+                "auditory_hit_rate,auditory_false_alarm_rate,auditory_dprime,mean_response_time_ms\n";
+    for (const auto& level : levels) {
+        const LevelSummary& l = level.second;
+        double mean = l.accuracySum / l.sessions;
+        double variance = l.sessions > 1 ?
+            max(0.0, (l.accuracySquares - l.sessions * mean * mean) / (l.sessions - 1)) : 0;
+        
+        distribution << level.first << "," << l.sessions << "," << fixed << setprecision(4)
+                     << (double)l.sessions / totalSessions << "," << l.players.size() << "\n";
+        accuracy << level.first << "," << l.sessions << fixed << setprecision(2) << "," << mean << ","
+                 << sqrt(variance) << setprecision(4) << ","
+                 << l.visual.hitRate() << "," << l.visual.falseAlarmRate() << "," << l.visual.dPrime() << ","
+                 << l.auditory.hitRate() << "," << l.auditory.falseAlarmRate() << "," << l.auditory.dPrime() << ","
+                 << setprecision(1);
+        if (l.responseTimeSessions > 0) accuracy << l.responseTimeSum / l.responseTimeSessions;
+        accuracy << "\n";
+    }
+    return distribution && accuracy;
+}
+
+bool writeAchievements(const string& path, const AchievementPartial& total) {
+    ofstream out(path);
+    if (!out) return false;
+    out << "achievement,unlocked_players,players,unlock_rate\n";
+    for (int i = 0; i < ACH_COUNT; i++) {
+        out << csvField(ACHIEVEMENT_NAMES[i]) << "," << total.unlocked[i] << "," << total.players << ","
+            << fixed << setprecision(4) << (total.players > 0 ? (double)total.unlocked[i] / total.players : 0.0)
+            << "\n";
+    }
+    return (bool)out;
+}
+
+int main(int argc, char* argv[]) {
+    string prefix = argc > 1 ? argv[1] : "nback_report_";
+    unsigned threads = argc > 2 ? (unsigned)atoi(argv[2]) : thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    auto started = chrono::steady_clock::now();
+    
+    // 历史成绩：索引按段分给各线程，每个线程只解码自己那段的记录
+    HistoryStore& history = HistoryStore::instance();
+    size_t sessions = history.prepareScan() ? history.size() : 0;
+    vector<HistoryPartial> historyParts(threads);
+    runPartitioned(sessions, threads, [&](unsigned part, size_t begin, size_t end) {
+        HistoryPartial& local = historyParts[part];
+        local.progress.reserve(end - begin);
+        history.scanRange((uint32_t)begin, (uint32_t)end, [&](uint32_t entry, const HistoryRecord& record) {
+            local.levels[record.stats.nValue].add(record.stats);
+            ProgressRow row;
+            row.entry = entry;
+            row.timestamp = record.timestamp;
+            row.stats = record.stats;
+            local.progress.push_back(row);
+        });
+    });
+    
+    map<int, LevelSummary> levels;
+    vector<ProgressRow> progress;
+    progress.reserve(sessions);
+    for (HistoryPartial& part : historyParts) {
+        for (const auto& level : part.levels) levels[level.first].merge(level.second);
+        progress.insert(progress.end(), part.progress.begin(), part.progress.end());
+        part = HistoryPartial();
+    }
+    
+    // 玩家数据：数据库记录按槽位分段并行解码，各线程只累加成就计数；
+    // 日志里较新的版本代替数据库中的旧记录
+    PlayerStatsStore& store = PlayerStatsStore::instance();
+    size_t records = store.databaseRecords();
+    vector<PlayerStats> newer = store.journalPlayers();
+    set<string> newerNames;
+    for (const PlayerStats& stats : newer) newerNames.insert(stats.name);
+    
+    vector<AchievementPartial> achievementParts(threads);
+    runPartitioned(records, threads, [&](unsigned part, size_t begin, size_t end) {
+        PlayerStats stats;
+        for (size_t slot = begin; slot < end; slot++) {
+            if (store.readSlot(slot, stats) && newerNames.count(stats.name) == 0) {
+                achievementParts[part].add(stats);
+            }
+        }
+    });
+    AchievementPartial achievements;
+    for (const AchievementPartial& part : achievementParts) achievements.merge(part);
+    for (const PlayerStats& stats : newer) achievements.add(stats);
+    
+    bool ok = writeProgress(prefix + "progress.csv", progress) &&
+              writeLevels(prefix + "n_levels.csv", prefix + "accuracy_by_n.csv", levels) &&
+              writeAchievements(prefix + "achievements.csv", achievements);
+    if (!ok) {
+        cerr << "写入报表失败: " << prefix << "*.csv\n";
+        return 1;
+    }
+    
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cout << "报表已生成: " << prefix << "{progress,n_levels,accuracy_by_n,achievements}.csv\n";
+    cout << "历史成绩 " << sessions << " 条，玩家 " << achievements.players << " 人，"
+         << threads << " 个线程，用时 " << fixed << setprecision(2) << elapsed << " 秒\n";
+    return 0;
+}